@@ -1,6 +1,12 @@
 #include "A2.hpp"
 #include "cs488-framework/GlErrorCheck.hpp"
 
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
 using namespace std;
 
@@ -11,23 +17,92 @@ using namespace std;
 #include <glm/gtx/io.hpp>
 using namespace glm;
 
-//----------------------------------------------------------------------------------------
-// Constructor
-VertexData::VertexData()
-	: numVertices(0),
-	  index(0)
+namespace {
+
+const vec3 kBackgroundColour(0.3f, 0.5f, 0.7f);
+
+// Values of A2::transformMode.
+const int kCpuTransform = 0;
+const int kGpuTransform = 1;
+const int kCompareTransforms = 2;
+
+// When comparing, the CPU path draws the mesh in red and the GPU path adds
+// green on top, so agreeing pixels come out yellow.
+const vec3 kCpuCompareColour(1.0f, 0.0f, 0.0f);
+const vec3 kGpuCompareColour(0.0f, 1.0f, 0.0f);
+
+// Distance between neighbouring cube instances, in world units.
+const float kInstanceSpacing = 4.0f;
+
+// Objects drawn through the camera, and through the cube's model matrix.
+const unsigned kDirtyCamera = kDirtyCube | kDirtyWorldGnom | kDirtyCubeGnom;
+const unsigned kDirtyModel = kDirtyCube | kDirtyCubeGnom;
+
+// Mouse rotations composed into view or model between re-orthonormalizations.
+const int kRotationsPerOrthonormalize = 64;
+
+// Frames drawn on demand after an event, so the GUI catches up with input
+// it sees a frame late.
+const int kSettleFrames = 3;
+
+// GUI settings as numbered in input recordings; append only, so older
+// recordings still replay.
+enum RecordedSetting {
+	kSettingMode,
+	kSettingInstances,
+	kSettingPackedVertices,
+	kSettingThreadedPipeline,
+	kSettingHiddenEdges,
+	kSettingLogicThread,
+	kSettingTransformMode
+};
+
+// "out.png" becomes "out_0007.png" when rendering several views.
+string numberedPath(const string & path, int index, int count)
 {
-	positions.resize(kMaxVertices);
-	colours.resize(kMaxVertices);
+	if (count <= 1) {
+		return path;
+	}
+	char suffix[16];
+	snprintf(suffix, sizeof(suffix), "_%04d", index);
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of('/');
+	if (dot == string::npos || (slash != string::npos && dot < slash)) {
+		return path + suffix;
+	}
+	return path.substr(0, dot) + suffix + path.substr(dot);
 }
 
+}
 
 //----------------------------------------------------------------------------------------
 // Constructor
-A2::A2()
-	: m_currentLineColour(vec3(0.0f)), worldMat(mat4(1.0f)), view(mat4(1.0f)), proj(mat4(1.0f)), model(mat4(1.0f)), modelScale(mat4(1.0f)), fovDegrees(30.0f), near(0.0f), far(20.0f), aspect(1.0f), mouseLeftPressed(false), mouseRightPressed(false), mouseMiddlePressed(false), mode(0), oldX(0), lowXBoundary(-0.9f), highXBoundary(0.9f), lowYBoundary(-0.9f), highYBoundary(0.9f)
+FrameLines::FrameLines()
+	: staleObjects(kDirtyAll),
+	  transformMode(kCpuTransform),
+	  viewProj(1.0f),
+	  instancesCulled(false),
+	  instanced(false)
 {
+	viewport.lowX = 0.0f;
+	viewport.highX = 0.0f;
+	viewport.lowY = 0.0f;
+	viewport.highY = 0.0f;
+}
 
+//----------------------------------------------------------------------------------------
+// Constructor
+A2::A2(const std::string & meshFile)
+	: m_firstVertex(0), m_drawnFrame(0), m_currentLineColour(vec3(0.0f)), m_currentPackedColour(packColour(vec3(0.0f))), m_stripHasPoint(false), m_stripJoined(false), worldMat(), view(), proj(mat4(1.0f)), model(), modelScale(), fovDegrees(30.0f), near(0.0f), far(20.0f), aspect(1.0f), mouseLeftPressed(false), mouseRightPressed(false), mouseMiddlePressed(false), mode(0), oldX(0), pendingMode(0), projectionChanged(false), rotationsApplied(0), replaying(false), replayGuiHovered(false), onDemand(false), framesToDraw(0), lowXBoundary(-0.9f), highXBoundary(0.9f), lowYBoundary(-0.9f), highYBoundary(0.9f), packedVertices(false), threadedPipeline(true), threadedLogic(true), hiddenEdges(false), lineFormat(VertexFormat::Float), meshFile(meshFile), dirtyObjects(kDirtyAll), lineTarget(nullptr), sceneUploaded(false), transformMode(kCpuTransform), instanceCount(0), instanceReach(0.0f), visibleInstancesChanged(false), streamBudget(0), cpuOnlyPixels(0), gpuOnlyPixels(0), frameBuilding(false)
+{
+	lineCounters.clear();
+	for (int i = 0; i < kSceneObjects; i++) {
+		objectCounters[i].clear();
+		objectOffsets[i] = 0;
+		objectIndexOffsets[i] = 0;
+		objectStripOffsets[i] = 0;
+	}
+	clearPendingInput();
 }
 
 //----------------------------------------------------------------------------------------
@@ -44,7 +119,7 @@ A2::~A2()
 void A2::init()
 {
 	// Set the background colour.
-	glClearColor(0.3, 0.5, 0.7, 1.0);
+	glClearColor(kBackgroundColour[0], kBackgroundColour[1], kBackgroundColour[2], 1.0);
 
 	createShaderProgram();
 
@@ -56,15 +131,152 @@ void A2::init()
 
 	mapVboDataToVertexAttributeLocation();
 
+	profiler.initGpuTimer();
+
+	initScene();
+
+	// Static copy of the mesh for the GPU transform path.  A streamed scene
+	// is uploaded chunk by chunk as chunks arrive instead, and a mapped one
+	// when the GPU path first draws it, so opening it reads no pages.
+	if (streamer.isRunning() || scene.isOpen()) {
+		meshBuffer.destroy();
+	} else {
+		meshBuffer.upload(cubeMesh, meshShader.getAttribLocation("position"));
+	}
+	sceneUploaded = false;
+	instanceBuffer.upload(cubeMesh, instanceShader.getAttribLocation("position"));
+	instanceBuffer.setInstanceAttribute(instanceShader.getAttribLocation("model"));
+
+	if (!capturePath.empty()) {
+		capture.start(capturePath);
+	}
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Scene and pipeline setup that needs no GL context, shared with headless runs.
+ */
+void A2::initScene()
+{
+	// Split the geometry pipeline across all cores.
+	threadPool.reset(new ThreadPool());
+	pipeline.setThreadPool(threadPool.get());
+
+	// Draw the unit cube unless a mesh or scene file was given on the command
+	// line.  A scene is mapped, not read, so opening it costs no parsing.
+	cubeMesh = Mesh::cube();
+	if (!meshFile.empty() && SceneFile::isSceneFile(meshFile)) {
+		if (!scene.open(meshFile)) {
+			cerr << "Falling back to the unit cube" << endl;
+		} else if (streamBudget > 0) {
+			streamer.start(scene, streamBudget);
+		}
+	} else if (!meshFile.empty() && !cubeMesh.load(meshFile)) {
+		cerr << "Falling back to the unit cube" << endl;
+	}
+
 	createProj(fovDegrees, near, far, aspect);
 //	view = translate(0, 0, -10);
 	view = createViewMatrix(vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 0.0f, -10.0f), vec3(0.0f, 1.0f, 0.0f) );
 }
 
+//----------------------------------------------------------------------------------------
+/*
+ * Renders without a window or GL context: each view goes through the same
+ * appLogic() pipeline, then the software rasterizer, then to an image file.
+ * With several views the camera orbits the world y axis between them.
+ */
+bool A2::renderHeadless(const std::string & imagePath, int width, int height, int views)
+{
+	initScene();
+	aspect = float(width) / float(height);
+	createProj(fovDegrees, near, far, aspect);
+
+	Framebuffer framebuffer(width, height);
+	for (int i = 0; i < views; i++) {
+		// Offline, so wait for the chunks this view wants.
+		streamer.waitUntilSettled(sceneCamera());
+		runFrameLogic();
+
+		framebuffer.clear(kBackgroundColour);
+		rasterizeLines(m_frames[m_drawnFrame].lines, framebuffer);
+		if (!framebuffer.write(numberedPath(imagePath, i, views))) {
+			return false;
+		}
+
+		view = view * rotate('y', 360.0f / views);
+		markDirty(kDirtyCamera);
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------------------
+bool A2::recordInput(const std::string & eventPath)
+{
+	return inputRecorder.open(eventPath);
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Replays a recording through the same event handlers a window would call,
+ * so the camera follows the recorded session exactly, and times each frame
+ * as renderHeadless() would draw it.
+ */
+bool A2::replayInput(const std::string & eventPath, const std::string & imagePath,
+		int width, int height, float frameStep)
+{
+	vector<InputEvent> events;
+	if (!loadInputEvents(eventPath, events)) {
+		return false;
+	}
+
+	initScene();
+	aspect = float(width) / float(height);
+	createProj(fovDegrees, near, far, aspect);
+	replaying = true;
+
+	Framebuffer framebuffer(width, height);
+	vector<float> logicTimes;
+	vector<float> rasterizeTimes;
+	cout << "frame,events,app_logic_ms,rasterize_ms" << endl;
+	size_t next = 0;
+	for (int frame = 0; frame == 0 || next < events.size(); frame++) {
+		// Everything that arrived by the end of this frame's step.
+		float frameEnd = float(frame + 1) * frameStep;
+		size_t first = next;
+		while (next < events.size() && events[next].time <= frameEnd) {
+			replayEvent(events[next++]);
+		}
+		streamer.waitUntilSettled(sceneCamera());
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		runFrameLogic();
+		chrono::steady_clock::time_point logicEnd = chrono::steady_clock::now();
+		framebuffer.clear(kBackgroundColour);
+		rasterizeLines(m_frames[m_drawnFrame].lines, framebuffer);
+		chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+		logicTimes.push_back(chrono::duration<float, milli>(logicEnd - start).count());
+		rasterizeTimes.push_back(chrono::duration<float, milli>(end - logicEnd).count());
+		cout << frame << "," << (next - first) << "," << logicTimes.back() << ","
+			<< rasterizeTimes.back() << "\n";
+	}
+	replaying = false;
+
+	cerr << "Replayed " << events.size() << " events in " << logicTimes.size() << " frames" << endl;
+	cerr << "  app logic ms: p50 " << percentile(logicTimes, 0.5f) << "  p95 "
+		<< percentile(logicTimes, 0.95f) << "  p99 " << percentile(logicTimes, 0.99f) << endl;
+	cerr << "  rasterize ms: p50 " << percentile(rasterizeTimes, 0.5f) << "  p95 "
+		<< percentile(rasterizeTimes, 0.95f) << "  p99 " << percentile(rasterizeTimes, 0.99f)
+		<< endl;
+
+	return imagePath.empty() || framebuffer.write(imagePath);
+}
+
 void A2::reset() {
-	worldMat = mat4(1.0f);
-	model = mat4(1.0f);
-	modelScale = mat4(1.0f);
+	worldMat = Affine();
+	model = Affine();
+	modelScale = Affine();
 	fovDegrees = 30.0f;
 	near = 0.0f;
 	far = 20.0f;
@@ -74,12 +286,285 @@ void A2::reset() {
 	mouseMiddlePressed = false;
 	mode = 0;
 	oldX = 0;
+	pendingMode = 0;
+	clearPendingInput();
+	projectionChanged = false;
 	lowXBoundary = -0.9f;
 	highXBoundary = 0.9f;
 	lowYBoundary = -0.9f;
 	highYBoundary = 0.9f;
 	createProj(fovDegrees, near, far, aspect);
 	view = createViewMatrix(vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 0.0f, -10.0f), vec3(0.0f, 1.0f, 0.0f));
+	markDirty(kDirtyAll);
+}
+
+//----------------------------------------------------------------------------------------
+void A2::clearPendingInput()
+{
+	for (int button = 0; button < 3; button++) {
+		pendingMotion[button] = (pendingMode == 5) ? 1.0f : 0.0f;
+	}
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Applies the mouse motion gathered since the last frame: one matrix
+ * product per button and mode, however many events arrived.
+ */
+void A2::applyPendingInput()
+{
+	const char axes[3] = {'x', 'y', 'z'};
+	const float * motion = pendingMotion;
+	if (pendingMode == 0 || pendingMode == 3) {
+		for (int button = 0; button < 3; button++) {
+			if (motion[button] == 0.0f) {
+				continue;
+			}
+			Affine rot = rotate(axes[button], motion[button]);
+			if (pendingMode == 0) {
+				view = rot * view;
+			}
+			else {
+				model = model * rot;
+			}
+			rotationsApplied++;
+		}
+	}
+	else if (pendingMode == 1) {
+		view = translate(motion[0], motion[1], motion[2]) * view;
+	}
+	else if (pendingMode == 4) {
+		model = model * translate(motion[0], motion[1], motion[2]);
+	}
+	else if (pendingMode == 5) {
+		modelScale = modelScale * scale(motion[0], motion[1], motion[2]);
+	}
+	clearPendingInput();
+
+	if (projectionChanged) {
+		createProj(fovDegrees, near, far, aspect);
+		projectionChanged = false;
+	}
+
+	// Rounding in each product pulls the rotations away from orthonormal;
+	// snap them back before it can show as skew.
+	if (rotationsApplied >= kRotationsPerOrthonormalize) {
+		view = view.orthonormalized();
+		model = model.orthonormalized();
+		rotationsApplied = 0;
+	}
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Whether the mouse is over a GUI window, which keeps events from the scene;
+ * a replay has the state recorded with the event instead.
+ */
+bool A2::guiHovered() const
+{
+	return replaying ? replayGuiHovered : ImGui::IsMouseHoveringAnyWindow();
+}
+
+//----------------------------------------------------------------------------------------
+void A2::recordEvent(InputEvent event)
+{
+	if (inputRecorder.isOpen()) {
+		event.flags = guiHovered() ? InputEvent::kGuiHovered : 0;
+		inputRecorder.record(event);
+	}
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Keeps a window event for applyQueuedEvents(), with the GUI hover state as
+ * it is now.
+ */
+bool A2::queueEvent(InputEvent event)
+{
+	recordEvent(event);
+	event.flags = guiHovered() ? InputEvent::kGuiHovered : 0;
+	queuedEvents.push_back(event);
+	requestFrames(kSettleFrames);
+	return true;
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Applies the window events that arrived since the last frame, in order,
+ * the way a replay applies recorded ones.
+ */
+void A2::applyQueuedEvents()
+{
+	bool wasReplaying = replaying;
+	replaying = true;
+	for (const InputEvent & event : queuedEvents) {
+		replayEvent(event);
+	}
+	replaying = wasReplaying;
+	queuedEvents.clear();
+}
+
+//----------------------------------------------------------------------------------------
+void A2::setOnDemand(bool enabled)
+{
+	onDemand = enabled;
+}
+
+//----------------------------------------------------------------------------------------
+void A2::requestFrames(int frames)
+{
+	framesToDraw = std::max(framesToDraw, frames);
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Drawing on demand, blocks in the event wait until the next frame has
+ * something to show.  The callbacks run inside the wait and queue their
+ * events as usual; any event, including ones only the GUI sees, wakes the
+ * loop for a few frames.
+ */
+void A2::waitForActivity()
+{
+	if (!onDemand || replaying) {
+		return;
+	}
+	if (framesToDraw == 0 && queuedEvents.empty() && dirtyObjects == 0 &&
+			!glfwWindowShouldClose(m_window)) {
+		glfwWaitEvents();
+		requestFrames(kSettleFrames);
+	}
+	if (framesToDraw > 0) {
+		framesToDraw--;
+	}
+}
+
+//----------------------------------------------------------------------------------------
+void A2::captureFrames(const std::string & path)
+{
+	capturePath = path;
+}
+
+//----------------------------------------------------------------------------------------
+void A2::replayEvent(const InputEvent & event)
+{
+	replayGuiHovered = (event.flags & InputEvent::kGuiHovered) != 0;
+	switch (event.type) {
+	case InputEvent::MouseMove:
+		handleMouseMove(event.x, event.y);
+		break;
+	case InputEvent::MouseButton:
+		handleMouseButton(event.code, event.action, event.mods);
+		break;
+	case InputEvent::Key:
+		handleKey(event.code, event.action, event.mods);
+		break;
+	case InputEvent::Setting:
+		changeSetting(event.code, event.action);
+		break;
+	case InputEvent::Reset:
+		reset();
+		break;
+	}
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * A setting changed through the GUI, recorded so a replay can change it too.
+ */
+void A2::changeSetting(int setting, int value)
+{
+	switch (setting) {
+	case kSettingMode:
+		mode = value;
+		break;
+	case kSettingInstances:
+		setInstanceCount(value);
+		break;
+	case kSettingPackedVertices:
+		packedVertices = value != 0;
+		break;
+	case kSettingThreadedPipeline:
+		threadedPipeline = value != 0;
+		break;
+	case kSettingHiddenEdges:
+		hiddenEdges = value != 0;
+		markDirty(kDirtyCube);
+		break;
+	case kSettingLogicThread:
+		threadedLogic = value != 0;
+		break;
+	case kSettingTransformMode:
+		if (value >= kCpuTransform && value <= kCompareTransforms) {
+			transformMode = value;
+			markDirty(kDirtyAll);
+		}
+		break;
+	}
+}
+
+//----------------------------------------------------------------------------------------
+void A2::setStreamBudget(size_t bytes)
+{
+	streamBudget = bytes;
+}
+
+//----------------------------------------------------------------------------------------
+void A2::setInstanceCount(int count)
+{
+	instanceCount = max(0, count);
+	instances = instanceGrid(size_t(instanceCount), kInstanceSpacing, 488);
+	markDirty(kDirtyCube);
+}
+
+//----------------------------------------------------------------------------------------
+void A2::updateInstanceBvh()
+{
+	// Built on first use after a change of count.  Each instance is only
+	// its origin, so the tree does not depend on model * modelScale, which
+	// every instance applies first; instanceCullMargin() covers the mesh.
+	if (instanceBvh.size() == instances.size()) {
+		return;
+	}
+	vector<Aabb> boxes(instances.size());
+	instanceReach = 0.0f;
+	for (size_t i = 0; i < instances.size(); i++) {
+		const float (*m)[4] = instances[i].rows;
+		vec3 origin(m[0][3], m[1][3], m[2][3]);
+		boxes[i].low = origin;
+		boxes[i].high = origin;
+		for (int r = 0; r < 3; r++) {
+			instanceReach = std::max(instanceReach, length(vec3(m[r][0], m[r][1], m[r][2])));
+		}
+	}
+	instanceBvh.build(boxes);
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * How far past its origin any instance's mesh can reach along an axis: the
+ * mesh lies within the farthest corner of its box under model * modelScale,
+ * and no instance stretches an axis by more than instanceReach.  O(1), so
+ * moving the model needs no refit.
+ */
+float A2::instanceCullMargin() const
+{
+	Aabb meshBox;
+	cubeMesh.bounds(meshBox.low, meshBox.high);
+	Affine local = model * modelScale;
+	float radius = 0.0f;
+	for (int corner = 0; corner < 8; corner++) {
+		vec4 point((corner & 1) ? meshBox.high[0] : meshBox.low[0],
+				(corner & 2) ? meshBox.high[1] : meshBox.low[1],
+				(corner & 4) ? meshBox.high[2] : meshBox.low[2], 1.0f);
+		radius = std::max(radius, length(vec3(local * point)));
+	}
+	return radius * instanceReach;
+}
+
+//----------------------------------------------------------------------------------------
+void A2::markDirty(unsigned objects)
+{
+	dirtyObjects |= objects;
 }
 
 //----------------------------------------------------------------------------------------
@@ -89,6 +574,16 @@ void A2::createShaderProgram()
 	m_shader.attachVertexShader( getAssetFilePath("VertexShader.vs").c_str() );
 	m_shader.attachFragmentShader( getAssetFilePath("FragmentShader.fs").c_str() );
 	m_shader.link();
+
+	meshShader.generateProgramObject();
+	meshShader.attachVertexShader( getAssetFilePath("MeshVertexShader.vs").c_str() );
+	meshShader.attachFragmentShader( getAssetFilePath("FragmentShader.fs").c_str() );
+	meshShader.link();
+
+	instanceShader.generateProgramObject();
+	instanceShader.attachVertexShader( getAssetFilePath("InstanceVertexShader.vs").c_str() );
+	instanceShader.attachFragmentShader( getAssetFilePath("FragmentShader.fs").c_str() );
+	instanceShader.link();
 }
 
 //----------------------------------------------------------------------------------------
@@ -113,39 +608,11 @@ void A2::enableVertexAttribIndices()
 //----------------------------------------------------------------------------------------
 void A2::generateVertexBuffers()
 {
-	// Generate a vertex buffer to store line vertex positions
-	{
-		glGenBuffers(1, &m_vbo_positions);
-
-		glBindBuffer(GL_ARRAY_BUFFER, m_vbo_positions);
-
-		// Set to GL_DYNAMIC_DRAW because the data store will be modified frequently.
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vec2) * kMaxVertices, nullptr,
-				GL_DYNAMIC_DRAW);
-
-
-		// Unbind the target GL_ARRAY_BUFFER, now that we are finished using it.
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		CHECK_GL_ERRORS;
-	}
-
-	// Generate a vertex buffer to store line colors
-	{
-		glGenBuffers(1, &m_vbo_colours);
+	// Generate the position, colour and index buffers, each split into ring
+	// regions that frames take turns writing.
+	m_vertexStream.allocate(kInitialVertices, kInitialVertices, kInitialVertices, lineFormat);
 
-		glBindBuffer(GL_ARRAY_BUFFER, m_vbo_colours);
-
-		// Set to GL_DYNAMIC_DRAW because the data store will be modified frequently.
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vec3) * kMaxVertices, nullptr,
-				GL_DYNAMIC_DRAW);
-
-
-		// Unbind the target GL_ARRAY_BUFFER, now that we are finished using it.
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		CHECK_GL_ERRORS;
-	}
+	CHECK_GL_ERRORS;
 }
 
 //----------------------------------------------------------------------------------------
@@ -154,17 +621,32 @@ void A2::mapVboDataToVertexAttributeLocation()
 	// Bind VAO in order to record the data mapping.
 	glBindVertexArray(m_vao);
 
-	// Tell GL how to map data from the vertex buffer "m_vbo_positions" into the
-	// "position" vertex attribute index for any bound shader program.
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_positions);
 	GLint positionAttribLocation = m_shader.getAttribLocation( "position" );
-	glVertexAttribPointer(positionAttribLocation, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
-
-	// Tell GL how to map data from the vertex buffer "m_vbo_colours" into the
-	// "colour" vertex attribute index for any bound shader program.
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_colours);
 	GLint colorAttribLocation = m_shader.getAttribLocation( "colour" );
-	glVertexAttribPointer(colorAttribLocation, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+	if (m_vertexStream.format() == VertexFormat::Packed) {
+		// Both attributes come from one interleaved buffer, and GL converts the
+		// normalized integers back to floats for the shader.
+		GLsizei stride = sizeof(PackedVertex);
+		glBindBuffer(GL_ARRAY_BUFFER, m_vertexStream.interleavedBuffer());
+		glVertexAttribPointer(positionAttribLocation, 2, GL_SHORT, GL_TRUE, stride,
+				reinterpret_cast<void *>(offsetof(PackedVertex, x)));
+		glVertexAttribPointer(colorAttribLocation, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+				reinterpret_cast<void *>(offsetof(PackedVertex, r)));
+	} else {
+		// Tell GL how to map data from the vertex stream's position buffer into the
+		// "position" vertex attribute index for any bound shader program.
+		glBindBuffer(GL_ARRAY_BUFFER, m_vertexStream.positionBuffer());
+		glVertexAttribPointer(positionAttribLocation, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+		// Tell GL how to map data from the vertex stream's colour buffer into the
+		// "colour" vertex attribute index for any bound shader program.
+		glBindBuffer(GL_ARRAY_BUFFER, m_vertexStream.colourBuffer());
+		glVertexAttribPointer(colorAttribLocation, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+	}
+
+	// The element buffer binding is VAO state, so it stays bound for draw().
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_vertexStream.indexBuffer());
 
 	//-- Unbind target, and restore default values:
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -176,8 +658,13 @@ void A2::mapVboDataToVertexAttributeLocation()
 //---------------------------------------------------------------------------------------
 void A2::initLineData()
 {
-	m_vertexData.numVertices = 0;
-	m_vertexData.index = 0;
+	// Format changes from the GUI take effect at the start of a frame, and
+	// invalidate every cached object.
+	VertexFormat format = packedVertices ? VertexFormat::Packed : VertexFormat::Float;
+	if (format != lineFormat) {
+		lineFormat = format;
+		markDirty(kDirtyAll);
+	}
 }
 
 //---------------------------------------------------------------------------------------
@@ -185,6 +672,7 @@ void A2::setLineColour (
 		const glm::vec3 & colour
 ) {
 	m_currentLineColour = colour;
+	m_currentPackedColour = packColour(colour);
 }
 
 //---------------------------------------------------------------------------------------
@@ -192,30 +680,67 @@ void A2::drawLine(
 		const glm::vec2 & v0,   // Line Start (NDC coordinate)
 		const glm::vec2 & v1    // Line End (NDC coordinate)
 ) {
+	lineTarget->addLine(v0, v1, m_currentLineColour, m_currentPackedColour);
+	lineCounters.emitted++;
+}
+
+//---------------------------------------------------------------------------------------
+void A2::beginStrip()
+{
+	m_stripHasPoint = false;
+	m_stripJoined = false;
+}
+
+//---------------------------------------------------------------------------------------
+void A2::stripVertex(
+		const glm::vec2 & point   // Next corner (NDC coordinate)
+) {
+	if (!m_stripHasPoint) {
+		m_stripPoint = point;
+		m_stripHasPoint = true;
+		return;
+	}
 
-	m_vertexData.positions[m_vertexData.index] = v0;
-	m_vertexData.colours[m_vertexData.index] = m_currentLineColour;
-	++m_vertexData.index;
-	m_vertexData.positions[m_vertexData.index] = v1;
-	m_vertexData.colours[m_vertexData.index] = m_currentLineColour;
-	++m_vertexData.index;
+	vec2 previous = m_stripPoint;
+	vec2 start = previous;
+	vec2 end = point;
+	m_stripPoint = point;
+	if (!clipXY(start, end)) {
+		m_stripJoined = false;
+		lineCounters.rejected++;
+		return;
+	}
 
-	m_vertexData.numVertices += 2;
+	// A start moved by clipping leaves a gap after the previous line, so a
+	// new strip begins there.
+	if (!m_stripJoined || start != previous) {
+		lineTarget->endStrip();
+		lineTarget->addStripVertex(
+				lineTarget->addVertex(start, m_currentLineColour, m_currentPackedColour));
+	}
+	lineTarget->addStripVertex(
+			lineTarget->addVertex(end, m_currentLineColour, m_currentPackedColour));
+	lineCounters.emitted++;
+	m_stripJoined = (end == point);
 }
 
-mat4 A2::createViewMatrix(vec3 lookAt, vec3 lookFrom, vec3 up) {
+//---------------------------------------------------------------------------------------
+void A2::endStrip()
+{
+	lineTarget->endStrip();
+	m_stripHasPoint = false;
+	m_stripJoined = false;
+}
+
+Affine A2::createViewMatrix(vec3 lookAt, vec3 lookFrom, vec3 up) {
 	vec3 vz = normalize(lookAt - lookFrom);
 	vec3 vx = normalize(cross(up, vz));
 	vec3 vy = cross(vz, vx);
-	mat4 r(0.0f);
-	r[0][0] = vx[0]; r[1][0] = vx[1]; r[2][0] = vx[2];
-	r[0][1] = vy[0]; r[1][1] = vy[1]; r[2][1] = vy[2];
-	r[0][2] = vz[0]; r[1][2] = vz[1]; r[2][2] = vz[2];
-	r[3][3] = 1;
-	mat4 t(1.0f);
-	t[3][0] = lookFrom[0] * (-1);
-	t[3][1] = lookFrom[1] * (-1);
-	t[3][2] = lookFrom[2] * (-1);
+	Affine r;
+	r.rows[0][0] = vx[0]; r.rows[0][1] = vx[1]; r.rows[0][2] = vx[2];
+	r.rows[1][0] = vy[0]; r.rows[1][1] = vy[1]; r.rows[1][2] = vy[2];
+	r.rows[2][0] = vz[0]; r.rows[2][1] = vz[1]; r.rows[2][2] = vz[2];
+	Affine t = Affine::translation(lookFrom[0] * (-1), lookFrom[1] * (-1), lookFrom[2] * (-1));
 
 	return (r * t);
 }			
@@ -236,401 +761,202 @@ vec2 A2::orthographicProjection(vec4 point) {
 }
 
 vec2 A2::projection(vec4 point) {
-	vec4 point2 = proj * view * worldMat * modelScale * model * point;
+	vec4 point2 = proj * (view * worldMat * modelScale * model * point);
 	point2 = normalize(point2);
 	vec2 ans(point2[0], point2[1]);
 	return ans;
 }
 
-mat4 A2::translate(float xDiff, float yDiff, float zDiff) {
-	mat4 trans(1.0f);
-	trans[3][0] = xDiff;
-	trans[3][1] = yDiff;
-	trans[3][2] = zDiff;
-	return trans;
+Affine A2::translate(float xDiff, float yDiff, float zDiff) {
+	return Affine::translation(xDiff, yDiff, zDiff);
 }
 
-mat4 A2::rotate(char axis, float degrees) {
-	mat4 rot(1.0f);
-	if (axis == 'x') {
-		rot[1][1] = cos(radians(degrees));
-		rot[1][2] = sin(radians(degrees));
-		rot[2][1] = -1 * sin(radians(degrees));
-		rot[2][2] = cos(radians(degrees));
-	}
-	else if (axis == 'y') {
-		rot[0][0] = cos(radians(degrees));
-		rot[2][0] = sin(radians(degrees));
-		rot[0][2] = -1 * sin(radians(degrees));
-		rot[2][2] = cos(radians(degrees));
-	}
-	else if (axis == 'z') {
-		rot[0][0] = cos(radians(degrees));
-		rot[1][0] = -1 * sin(radians(degrees));
-		rot[0][1] = sin(radians(degrees));
-		rot[1][1] = cos(radians(degrees));
-	}
-	return rot;
+Affine A2::rotate(char axis, float degrees) {
+	return Affine::rotation(axis, degrees);
 }
 	
-mat4 A2::scale(float xScale, float yScale, float zScale) {
-	mat4 sc(1.0f);
-	sc[0][0] = xScale;
-	sc[1][1] = yScale;
-	sc[2][2] = zScale;
-	return sc;
+Affine A2::scale(float xScale, float yScale, float zScale) {
+	return Affine::scaling(xScale, yScale, zScale);
 }		
 
-bool A2::clipZ(vec4 &point1, vec4 &point2) {
-	return true;
-	bool point1In = true;
-	bool point2In = true;
-	if ((point1[2] < near) || (point1[2] > far)) {
-		point1In = false;
-	}
-	if ((point2[2] < near) || (point2[2] > far)) {
-		point2In = false;
-	}
-	if (point1In && point2In) {
-		return true;
-	}
-	else if (!point1In && !point2In) {
-		return false;
-	}
-	else if (!point1In) {
-		vec3 normal;
-		vec3 P;
-		if (point1[2] < near) {
-			normal = vec3(0, 0, 1);
-			P = vec3(0, 0, near);
-		}
-		else if (point1[2] > far) {
-			normal = vec3(0, 0, -1);
-			P = vec3(0, 0, near);
-		}
-		float t = (dot( (vec3(point1) - P), normal)) / (dot( (vec3(point1) - vec3(point2)), normal));
-		vec3 newPoint = vec3(point1) + (t * (vec3(point2) - vec3(point1) ) );
-		point1[0] = newPoint[0];
-		point1[1] = newPoint[1];
-		point1[2] = newPoint[2];
-		return true;			
-	}
-	else if (!point2In) {
-		vec3 normal;
-		vec3 P;
-		if (point2[2] < near) { 
-                        normal = vec3(0, 0, 1);
-                        P = vec3(0, 0, near);
-                }
-                else if (point2[2] > far) {
-                        normal = vec3(0, 0, -1); 
-                        P = vec3(0, 0, near);
-                }
-                float t = (dot( (vec3(point2) - P), normal)) / (dot( (vec3(point2) - vec3(point1)), normal));
-                vec3 newPoint = vec3(point2) + (t * (vec3(point2) - vec3(point1) ) );
-                point2[0] = newPoint[0];
-                point2[1] = newPoint[1];
-                point2[2] = newPoint[2];
-                return true;  
-	} 
-}
-
-float findYOnLine(float slope, vec2 point, float x) {
-	return (slope * (x - point[0])) + point[1];
+ClipRect A2::viewportRect() const {
+	ClipRect rect = {lowXBoundary, highXBoundary, lowYBoundary, highYBoundary};
+	return rect;
 }
 
-float findXOnLine(float slope, vec2 point, float y) {
-	return ((y - point[1])/slope) + point[0];
-}
-	
 bool A2::clipXY(vec2 &point1, vec2 &point2) {
-	bool point1LowX = !(point1[0] < lowXBoundary);
-	bool point1HighX = !(point1[0] > highXBoundary);
-	bool point1LowY = !(point1[1] < lowYBoundary); 
-	bool point1HighY = !(point1[1] > highYBoundary);
-	bool point2LowX = !(point2[0] < lowXBoundary);
-        bool point2HighX = !(point2[0] > highXBoundary);
-        bool point2LowY = !(point2[1] < lowYBoundary);
-        bool point2HighY = !(point2[1] > highYBoundary);
-
-	if (!((point1LowX || point2LowX) 
-              && (point1HighX || point2HighX) 
-              && (point1LowY || point2LowY) 
-	      && (point1HighY || point2HighY))) {
-		return false;
-	}
-	else if ((point1LowX && point2LowX)
-            && (point1HighX && point2HighX)
-            && (point1LowY && point2LowY)
-            && (point1HighY && point2HighY)) {
-		return true;
-	}	  
-	else {
-		float slope = (point2[1] - point1[1]) / (point2[0] - point1[0]);
-			if (point1[0] < lowXBoundary) {
-				float y = findYOnLine(slope, point2, lowXBoundary);
-				bool goodPoint = true;
-				if (y < lowYBoundary || y > highYBoundary) {
-					goodPoint = false;
-				}
-				if (goodPoint) {
-					point1[0] = lowXBoundary;
-					point1[1] = y;
-				}
-			}
-			if (point1[1] < lowYBoundary) {
-				float x = findXOnLine(slope, point2, lowYBoundary);
-				bool goodPoint = true;
-				if (x < lowXBoundary || x > highXBoundary) {
-					goodPoint = false;
-				}
-				if (goodPoint) {
-					point1[0] = x;
-					point1[1] = lowYBoundary;
-				}
-			}
-			if (point1[0] > highXBoundary) {
-				float y = findYOnLine(slope, point2, highXBoundary);
-				bool goodPoint = true;
-				if (y < lowYBoundary || y > highYBoundary) {
-                                        goodPoint = false;
-                                }
-                                if (goodPoint) {
-                                        point1[0] = highXBoundary;
-                                        point1[1] = y;
-                                }
-			}
-			if (point1[1] > highYBoundary) {
-                                float x = findXOnLine(slope, point2, highYBoundary);
-                                bool goodPoint = true;
-                                if (x < lowXBoundary || x > highXBoundary) {
-                                        goodPoint = false;
-                                }
-                                if (goodPoint) {
-                                        point1[0] = x;
-                                        point1[1] = highYBoundary;
-                                }
-                        }		 
-			if (point2[0] < lowXBoundary) {
-                                float y = findYOnLine(slope, point2, lowXBoundary);
-                                bool goodPoint = true;
-                                if (y < lowYBoundary || y > highYBoundary) {
-                                        goodPoint = false;
-                                }
-                                if (goodPoint) {
-                                        point2[0] = lowXBoundary;
-                                        point2[1] = y;
-                                }
-                        }
-                        if (point2[1] < lowYBoundary) {
-                                float x = findXOnLine(slope, point2, lowYBoundary);
-                                bool goodPoint = true;
-                                if (x < lowXBoundary || x > highXBoundary) {
-                                        goodPoint = false;
-                                }
-                                if (goodPoint) {
-                                        point2[0] = x;
-                                        point2[1] = lowYBoundary;
-                                }
-                        }
-			if (point2[0] > highXBoundary) {
-                                float y = findYOnLine(slope, point2, highXBoundary);
-                                bool goodPoint = true;
-                                if (y < lowYBoundary || y > highYBoundary) {
-                                        goodPoint = false;
-                                }
-                                if (goodPoint) {
-                                        point2[0] = highXBoundary;
-                                        point2[1] = y;
-                                }
-                        }
-                        if (point2[1] > highYBoundary) {
-                                float x = findXOnLine(slope, point2, highYBoundary);
-                                bool goodPoint = true;
-                                if (x < lowXBoundary || x > highXBoundary) {
-                                        goodPoint = false;
-                                }
-                                if (goodPoint) {
-                                        point2[0] = x;
-                                        point2[1] = highYBoundary;
-                                }
-                        }
-		return true;
-	}
-}	
-		
+	return clipSegment(viewportRect(), point1, point2);
+}
 		
+// Takes a clip-space point inside the view volume to the viewport.
 vec2 A2::drawProjection(vec4 point) {
-	point = normalize(point);
-	float vLength = highXBoundary - lowXBoundary;	
-	float wLength = 2;
-	float vHeight = highYBoundary - lowYBoundary;
-	float wHeight = 2;
-	point[0] = (vLength / wLength) * (point[0] - (-1)) + lowXBoundary;
-	point[1] = (vHeight / wHeight) * (point[1] - (-1)) + lowYBoundary;
-        return vec2(point[0], point[1]);
+	return projectToViewport(point, viewportRect());
 }
 	
 			
 
-void A2::drawCube()
+void A2::drawClipSpaceLine(vec4 point1, vec4 point2)
 {
-	vec4 line1a(1.0f, 1.0f, 1.0f, 1.0f);
-	vec4 line1b(-1.0f, 1.0f, 1.0f, 1.0f);
-
- 	vec4 line2a(-1.0f, 1.0f, 1.0f, 1.0f);
-	vec4 line2b(-1.0f, -1.0f, 1.0f, 1.0f);
-
-	vec4 line3a(-1.0f, -1.0f, 1.0f, 1.0f);
-	vec4 line3b(1.0f, -1.0f, 1.0f, 1.0f);
-
-	vec4 line4a(1.0f, -1.0f, 1.0f, 1.0f);
-	vec4 line4b(1.0f, 1.0f, 1.0f, 1.0f);
-
-	vec4 line5a(1.0f, 1.0f, 1.0f, 1.0f);
-	vec4 line5b(1.0f, 1.0f, -1.0f, 1.0f);
-
-	vec4 line6a(-1.0f, 1.0f, 1.0f, 1.0f);
-        vec4 line6b(-1.0f, 1.0f, -1.0f, 1.0f);
-
-	vec4 line7a(-1.0f, -1.0f, 1.0f, 1.0f);
-        vec4 line7b(-1.0f, -1.0f, -1.0f, 1.0f);
-
-	vec4 line8a(1.0f, -1.0f, 1.0f, 1.0f);
-        vec4 line8b(1.0f, -1.0f, -1.0f, 1.0f);
+	uint8_t code1 = outcode(point1);
+	uint8_t code2 = outcode(point2);
+	if (!clipHomogeneous(point1, point2, code1, code2)) {
+		lineCounters.rejected++;
+		return;
+	}
+	vec2 line1 = drawProjection(point1);
+	vec2 line2 = drawProjection(point2);
+	if (!clipXY(line1, line2)) {
+		// Counted once, as rejected, even if it was clipped above.
+		lineCounters.rejected++;
+		return;
+	}
+	if (code1 | code2) {
+		lineCounters.clipped++;
+	}
+	drawLine(line1, line2);
+}
 
-	vec4 line9a(1.0f, 1.0f, -1.0f, 1.0f);
-        vec4 line9b(-1.0f, 1.0f, -1.0f, 1.0f);
+void A2::drawCube()
+{
+	ScopedTimer timer(profiler, Stage::DrawCube);
 
-	vec4 line10a(-1.0f, 1.0f, -1.0f, 1.0f);
-        vec4 line10b(-1.0f, -1.0f, -1.0f, 1.0f);
+	if (scene.isOpen()) {
+		drawSceneObjects();
+		return;
+	}
 
-	vec4 line11a(-1.0f, -1.0f, -1.0f, 1.0f);
-        vec4 line11b(1.0f, -1.0f, -1.0f, 1.0f);
+	// Instances outside the view volume are dropped before any edge work,
+	// on either path.
+	mat4 viewProj = proj * (view * worldMat);
+	if (!instances.empty()) {
+		updateInstanceBvh();
+		instanceBvh.cull(viewProj, visibleInstances, instanceCullMargin());
+		visibleInstancesChanged = true;
+	}
 
-	vec4 line12a(1.0f, -1.0f, -1.0f, 1.0f);
-        vec4 line12b(1.0f, 1.0f, -1.0f, 1.0f);
+	// The GPU path draws the mesh from its static buffer in draw().
+	if (transformMode == kGpuTransform) {
+		return;
+	}
+	setLineColour(transformMode == kCompareTransforms ? kCpuCompareColour : vec3(0.0f));
+
+	// The eye, for hiding back edges: in the mesh's space for the single
+	// cube, and in the space the instances are placed in for a grid.
+	vec3 eye = instances.empty() ? sceneCamera() :
+			vec3((view * worldMat).inverse() * vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	const vec3 * hideFrom = hiddenEdges ? &eye : nullptr;
+	if (instances.empty()) {
+		pipeline.drawMesh(cubeMesh, viewProj * (model * modelScale), viewportRect(),
+				m_currentLineColour, *lineTarget, hideFrom);
+	} else {
+		pipeline.drawInstances(cubeMesh, instances, visibleInstances, viewProj,
+				model * modelScale, viewportRect(), m_currentLineColour, *lineTarget, hideFrom);
+	}
+	lineCounters += pipeline.counters();
+}
 
-	vec4 cubeLines[12][2];
-	
-	cubeLines[0][0] = line1a;
-	cubeLines[0][1] = line1b;
-	cubeLines[1][0] = line2a;
-	cubeLines[1][1] = line2b;
-	cubeLines[2][0] = line3a;
-        cubeLines[2][1] = line3b;
-	cubeLines[3][0] = line4a;
-        cubeLines[3][1] = line4b;
-	cubeLines[4][0] = line5a;
-        cubeLines[4][1] = line5b;
-	cubeLines[5][0] = line6a;
-        cubeLines[5][1] = line6b;
-	cubeLines[6][0] = line7a;
-        cubeLines[6][1] = line7b;
-	cubeLines[7][0] = line8a;
-        cubeLines[7][1] = line8b;
-	cubeLines[8][0] = line9a;
-        cubeLines[8][1] = line9b;
-	cubeLines[9][0] = line10a;
-        cubeLines[9][1] = line10b;
-	cubeLines[10][0] = line11a;
-        cubeLines[10][1] = line11b;
-	cubeLines[11][0] = line12a;
-        cubeLines[11][1] = line12b;
-
-	vec2 cubeLinesProj[12][2];
-
-	bool keepLine[12];
-
-	for(int i = 0; i < 12; i++) {
-		vec4 point1 = view * worldMat * model * modelScale * cubeLines[i][0];
-      		vec4 point2 = view * worldMat * model * modelScale * cubeLines[i][1];
-		keepLine[i] = clipZ(point1, point2);
-		point1 = proj * point1;
-		point2 = proj * point2;
-		cubeLinesProj[i][0] = drawProjection(point1);
-		cubeLinesProj[i][1] = drawProjection(point2);
+//----------------------------------------------------------------------------------------
+/*
+ * Draws every object of the scene file, straight from the mapped file, each
+ * under its own transform and in its own colour.  When streaming, only the
+ * resident chunks are drawn, from their in-memory copies.
+ */
+void A2::drawSceneObjects()
+{
+	if (transformMode == kGpuTransform) {
+		return;
 	}
-	
-	setLineColour(vec3(0.0f, 0.0f, 0.0f));
-	for (int i = 0; i < 12; i++) {
-		if (keepLine[i] && clipXY(cubeLinesProj[i][0], cubeLinesProj[i][1])) {
-			drawLine(cubeLinesProj[i][0], cubeLinesProj[i][1]);
+	mat4 viewProj = proj * (view * worldMat);
+	Affine local = model * modelScale;
+	for (size_t i = 0; i < scene.objectCount(); i++) {
+		if (streamer.isRunning() ? !streamer.isResident(i) : !scene.edgesValid(i)) {
+			continue;
 		}
+		setLineColour(transformMode == kCompareTransforms ? kCpuCompareColour : scene.colour(i));
+		pipeline.drawMesh(streamer.isRunning() ? streamer.mesh(i) : scene.mesh(i),
+				viewProj * (local * Affine(scene.transform(i))), viewportRect(),
+				m_currentLineColour, *lineTarget);
+		lineCounters += pipeline.counters();
 	}
 }
 
+//----------------------------------------------------------------------------------------
+/*
+ * The eye position in the space scene object transforms map into, which is
+ * where the streamer measures chunk distances.
+ */
+vec3 A2::sceneCamera() const
+{
+	return vec3((view * worldMat * model * modelScale).inverse() * vec4(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
 void A2::drawCubeGnom() {
+	ScopedTimer timer(profiler, Stage::DrawCubeGnom);
 	vec4 lines[3][2] = {
                 {vec4(0.0f, 0.0f, 0.0f, 1.0f), vec4(0.25f, 0.0f, 0.0f, 1.0f)},
                 {vec4(0.0f, 0.0f, 0.0f, 1.0f), vec4(0.0f, 0.25f, 0.0f, 1.0f)},
                 {vec4(0.0f, 0.0f, 0.0f, 1.0f), vec4(0.0f, 0.0f, 0.25f, 1.0f)},
         };
+	vec3 colours[3] = {
+		vec3(1.0f, 1.0f, 0.0f),
+		vec3(1.0f, 0.0f, 1.0f),
+		vec3(0.0f, 1.0f, 1.0f)
+	};
 
-        vec2 linesProj[3][2];
-
-        for (int i = 0; i < 3; i++) {
-                vec4 point1 = proj * view * model * lines[i][0];
-                vec4 point2 = proj * view * model * lines[i][1];
-                linesProj[i][0] = drawProjection(point1);
-                linesProj[i][1] = drawProjection(point2);
-        }
-
-        setLineColour(vec3(1.0f, 1.0f, 0.0f));
-	if (clipXY(linesProj[0][0], linesProj[0][1])) {
-        	drawLine(linesProj[0][0], linesProj[0][1]);
-	}
-        setLineColour(vec3(1.0f, 0.0f, 1.0f));
-	if (clipXY(linesProj[1][0], linesProj[1][1])) {
-        	drawLine(linesProj[1][0], linesProj[1][1]);
+	objectPoints.resize(6);
+	for (int i = 0; i < 3; i++) {
+		objectPoints.set(2 * i, lines[i][0]);
+		objectPoints.set(2 * i + 1, lines[i][1]);
 	}
-        setLineColour(vec3(0.0f, 1.0f, 1.0f));
-	if (clipXY(linesProj[2][0], linesProj[2][1])) {
-        	drawLine(linesProj[2][0], linesProj[2][1]);
+	transformPoints(proj * (view * model), objectPoints, clipPoints);
+
+	for (int i = 0; i < 3; i++) {
+		setLineColour(colours[i]);
+		drawClipSpaceLine(clipPoints.get(2 * i), clipPoints.get(2 * i + 1));
 	}
 }
 
 void A2::drawWorldGnom() {
+	ScopedTimer timer(profiler, Stage::DrawWorldGnom);
 	vec4 lines[3][2] = {
 		{vec4(0.0f, 0.0f, 0.0f, 1.0f), vec4(0.5f, 0.0f, 0.0f, 1.0f)},
 		{vec4(0.0f, 0.0f, 0.0f, 1.0f), vec4(0.0f, 0.5f, 0.0f, 1.0f)},		
 		{vec4(0.0f, 0.0f, 0.0f, 1.0f), vec4(0.0f, 0.0f, 0.5f, 1.0f)},
 	};
+	vec3 colours[3] = {
+		vec3(1.0f, 0.0f, 0.0f),
+		vec3(0.0f, 1.0f, 0.0f),
+		vec3(0.0f, 0.0f, 1.0f)
+	};
 	
-	vec2 linesProj[3][2];
-	
+	objectPoints.resize(6);
 	for (int i = 0; i < 3; i++) {
-		vec4 point1 = proj * view * lines[i][0];
-		vec4 point2 = proj * view * lines[i][1];
-                linesProj[i][0] = drawProjection(point1);
-                linesProj[i][1] = drawProjection(point2);
+		objectPoints.set(2 * i, lines[i][0]);
+		objectPoints.set(2 * i + 1, lines[i][1]);
 	}
+	transformPoints(proj * view, objectPoints, clipPoints);
 
-	setLineColour(vec3(1.0f, 0.0f, 0.0f));
-	if (clipXY(linesProj[0][0], linesProj[0][1])) {
-		drawLine(linesProj[0][0], linesProj[0][1]);
-	}
-	setLineColour(vec3(0.0f, 1.0f, 0.0f));
-	if (clipXY(linesProj[1][0], linesProj[1][1])) {
-		drawLine(linesProj[1][0], linesProj[1][1]);
+	for (int i = 0; i < 3; i++) {
+		setLineColour(colours[i]);
+		drawClipSpaceLine(clipPoints.get(2 * i), clipPoints.get(2 * i + 1));
 	}
-	setLineColour(vec3(0.0f, 0.0f, 1.0f)); 
-	if (clipXY(linesProj[2][0], linesProj[2][1])) {
- 		drawLine(linesProj[2][0], linesProj[2][1]);
-	}	
 }
 
 
 void A2::drawViewport() {
+	ScopedTimer timer(profiler, Stage::DrawViewport);
 	vec2 point1(lowXBoundary, lowYBoundary);
 	vec2 point2(lowXBoundary, highYBoundary);
 	vec2 point3(highXBoundary, lowYBoundary);
 	vec2 point4(highXBoundary, highYBoundary);
 	setLineColour(vec3(1.0f, 1.0f, 1.0f));
-	drawLine(point1, point2);
-	drawLine(point1, point3);
-	drawLine(point2, point4);
-	drawLine(point3, point4);
+	beginStrip();
+	stripVertex(point1);
+	stripVertex(point2);
+	stripVertex(point4);
+	stripVertex(point3);
+	stripVertex(point1);
+	endStrip();
 }	
 
 //----------------------------------------------------------------------------------------
@@ -640,10 +966,32 @@ void A2::drawViewport() {
 void A2::appLogic()
 {
 	// Place per frame, application logic here ...
+	waitForActivity();
+
+	ScopedTimer timer(profiler, Stage::AppLogic);
+
+	// The lines started last frame are done before their state changes.
+	endFrameBuild();
+
+	applyQueuedEvents();
 
 	// Call at the beginning of frame, before drawing lines:
 	initLineData();
 
+	pipeline.setThreadPool(threadedPipeline ? threadPool.get() : nullptr);
+
+	applyPendingInput();
+
+	// Chunks that arrived or left since the last frame change the cube.  A
+	// loader that had settled before the update has delivered everything.
+	bool settled = streamer.isSettled();
+	if (streamer.update(sceneCamera())) {
+		markDirty(kDirtyCube);
+	}
+	if (!settled) {
+		requestFrames(1);
+	}
+
 /*	// Draw outer square:
 	setLineColour(vec3(1.0f, 0.7f, 0.8f));
 	drawLine(vec2(-0.5f, -0.5f), vec2(0.5f, -0.5f));
@@ -659,10 +1007,215 @@ void A2::appLogic()
 	drawLine(vec2(0.25f, 0.25f), vec2(-0.25f, 0.25f));
 	drawLine(vec2(-0.25f, 0.25f), vec2(-0.25f, -0.25f));*/
 
-	drawViewport();
-	drawCube();
-	drawWorldGnom();
-	drawCubeGnom();
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * appLogic() and that frame's lines, finished before returning, for callers
+ * that use the lines straight away instead of drawing them.
+ */
+void A2::runFrameLogic()
+{
+	appLogic();
+	beginFrameBuild();
+	endFrameBuild();
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Starts the lines for the state as it is now on the logic thread, into
+ * the frame draw() is not drawing.  The matrices and sources the GPU path
+ * needs are copied now, so they match the lines whenever the frame is drawn.
+ */
+void A2::beginFrameBuild()
+{
+	endFrameBuild();
+
+	FrameLines & frame = m_frames[1 - m_drawnFrame];
+	frame.transformMode = transformMode;
+	frame.viewProj = proj * (view * worldMat);
+	frame.local = model * modelScale;
+	frame.viewport = viewportRect();
+	frame.instanced = !instances.empty();
+	frame.residentChunks.resize(streamer.isRunning() ? streamer.chunkCount() : 0);
+	for (size_t i = 0; i < frame.residentChunks.size(); i++) {
+		frame.residentChunks[i] = streamer.isResident(i) ? 1 : 0;
+	}
+
+	unsigned dirty = dirtyObjects;
+	dirtyObjects = 0;
+	frameBuilding = true;
+	if (threadedLogic) {
+		// A changed frame is first drawn by the next one.
+		if (dirty != 0) {
+			requestFrames(1);
+		}
+		logicThread.start([this, &frame, dirty]() { buildLines(frame, dirty); });
+	} else {
+		buildLines(frame, dirty);
+	}
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Waits for the frame beginFrameBuild() started, and makes it the one
+ * draw() draws.
+ */
+void A2::endFrameBuild()
+{
+	if (!frameBuilding) {
+		return;
+	}
+	logicThread.wait();
+
+	// A frame replaced before draw() uploaded it, as when the logic thread
+	// is turned off, passes on what it changed.
+	FrameLines & skipped = m_frames[m_drawnFrame];
+	FrameLines & built = m_frames[1 - m_drawnFrame];
+	built.vertices.add(skipped.vertices.begin, skipped.vertices.end);
+	built.indices.add(skipped.indices.begin, skipped.indices.end);
+	built.strips.add(skipped.strips.begin, skipped.strips.end);
+	if (skipped.instancesCulled && !built.instancesCulled) {
+		built.visibleInstances.swap(skipped.visibleInstances);
+		built.instancesCulled = true;
+	}
+	skipped.vertices.clear();
+	skipped.indices.clear();
+	skipped.strips.clear();
+	skipped.instancesCulled = false;
+
+	m_drawnFrame = 1 - m_drawnFrame;
+	frameBuilding = false;
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * The logic thread's part of a frame.  Only objects whose matrices or
+ * viewport changed are drawn again; the rest reuse their lines from an
+ * earlier frame.
+ */
+void A2::buildLines(FrameLines & frame, unsigned dirty)
+{
+	ScopedTimer timer(profiler, Stage::BuildLines);
+
+	for (int i = 0; i < kSceneObjects; i++) {
+		if (dirty & (1u << i)) {
+			drawObject(i);
+		}
+	}
+	assembleLineData(frame, dirty);
+
+	// Gathered here rather than by draw(), which only uploads them.  The CPU
+	// path keeps them waiting for a switch to the GPU.
+	frame.instancesCulled = visibleInstancesChanged && frame.transformMode != kCpuTransform;
+	if (frame.instancesCulled) {
+		frame.visibleInstances.resize(visibleInstances.size());
+		for (size_t i = 0; i < visibleInstances.size(); i++) {
+			frame.visibleInstances[i] = instances[visibleInstances[i]];
+		}
+		visibleInstancesChanged = false;
+	}
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Redraws one scene object into its cache, recording its line counters.
+ */
+void A2::drawObject(int object)
+{
+	VertexData & lines = objectLines[object];
+	lines.setFormat(lineFormat);
+	lines.clear();
+	lineTarget = &lines;
+	lineCounters.clear();
+
+	switch (1u << object) {
+	case kDirtyViewport:
+		drawViewport();
+		break;
+	case kDirtyCube:
+		drawCube();
+		break;
+	// The gnomons' colours would read as differences when comparing.
+	case kDirtyWorldGnom:
+		if (transformMode != kCompareTransforms) {
+			drawWorldGnom();
+		}
+		break;
+	case kDirtyCubeGnom:
+		if (transformMode != kCompareTransforms) {
+			drawCubeGnom();
+		}
+		break;
+	}
+
+	objectCounters[object] = lineCounters;
+	lineTarget = nullptr;
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Splices the object caches into a frame's lines, and records what changed
+ * since the previous frame for the upload: objects that were redrawn or
+ * moved.  An object's indices are rebased on its vertices, so any of its
+ * three offsets moving means copying all of it.  The frame was last
+ * assembled two frames ago, so it also takes what changed in between.
+ */
+void A2::assembleLineData(FrameLines & frame, unsigned dirty)
+{
+	size_t offset = 0;
+	size_t indexOffset = 0;
+	size_t stripOffset = 0;
+	frame.vertices.clear();
+	frame.indices.clear();
+	frame.strips.clear();
+	lineCounters.clear();
+
+	unsigned changed = 0;
+	for (int i = 0; i < kSceneObjects; i++) {
+		const VertexData & lines = objectLines[i];
+		size_t count = lines.numVertices;
+		size_t indexCount = lines.numIndices;
+		size_t stripCount = lines.numStripIndices;
+		if ((dirty & (1u << i)) || objectOffsets[i] != offset ||
+				objectIndexOffsets[i] != indexOffset || objectStripOffsets[i] != stripOffset) {
+			objectOffsets[i] = offset;
+			objectIndexOffsets[i] = indexOffset;
+			objectStripOffsets[i] = stripOffset;
+			frame.vertices.add(offset, offset + count);
+			frame.indices.add(indexOffset, indexOffset + indexCount);
+			frame.strips.add(stripOffset, stripOffset + stripCount);
+			changed |= 1u << i;
+		}
+		offset += count;
+		indexOffset += indexCount;
+		stripOffset += stripCount;
+		lineCounters += objectCounters[i];
+	}
+	for (FrameLines & other : m_frames) {
+		other.staleObjects |= changed;
+	}
+
+	VertexData & out = frame.lines;
+	if (out.format != lineFormat) {
+		out.setFormat(lineFormat);
+		frame.staleObjects = kDirtyAll;
+	}
+	out.grow(offset);
+	out.growIndices(indexOffset);
+	out.growStripIndices(stripOffset);
+	for (int i = 0; i < kSceneObjects; i++) {
+		if (frame.staleObjects & (1u << i)) {
+			out.copyAt(objectOffsets[i], objectIndexOffsets[i], objectStripOffsets[i],
+					objectLines[i]);
+		}
+	}
+	frame.staleObjects = 0;
+
+	out.index = GLuint(offset);
+	out.numVertices = GLsizei(offset);
+	out.numIndices = GLsizei(indexOffset);
+	out.numStripIndices = GLsizei(stripOffset);
 }
 
 //----------------------------------------------------------------------------------------
@@ -695,18 +1248,95 @@ void A2::guiLogic()
 
 		// Create Button, and check if it was clicked:
                 if( ImGui::Button( "Reset Application" ) ) {
+                        recordEvent(InputEvent::make(InputEvent::Reset, 0));
                         reset();
                 }
 
 		ImGui::Text( "Framerate: %.1f FPS", ImGui::GetIO().Framerate );
+		if (capture.isRunning()) {
+			ImGui::Text( "Captured %zu frames, %zu dropped", capture.framesCaptured(),
+					capture.framesDropped() );
+		}
 		ImGui::Text( "Near Plane: %.1f", near);
 		ImGui::Text( "Far Plane: %.1f", far);
 		ImGui::Text( "Mode: %.1d", mode);
 
+		// 8 bytes per vertex instead of 20; applies from the next frame.
+		if( ImGui::Checkbox( "Compact vertices", &packedVertices ) ) {
+			recordEvent(InputEvent::make(InputEvent::Setting, kSettingPackedVertices,
+					packedVertices));
+		}
+		if( ImGui::Checkbox( "Threaded pipeline", &threadedPipeline ) ) {
+			recordEvent(InputEvent::make(InputEvent::Setting, kSettingThreadedPipeline,
+					threadedPipeline));
+		}
+		// Builds the next frame's lines while this one draws, a frame behind.
+		if( ImGui::Checkbox( "Logic thread", &threadedLogic ) ) {
+			recordEvent(InputEvent::make(InputEvent::Setting, kSettingLogicThread,
+					threadedLogic));
+		}
+		// Sleeps between events.  Not recorded: a replay draws every frame.
+		ImGui::Checkbox( "Draw on demand", &onDemand );
+
+		// Closed meshes only: drop edges with both faces turned away.  Binary
+		// meshes and scene files store no face adjacency, so they cannot.
+		if (scene.isOpen() || cubeMesh.edgeFaces.empty()) {
+			ImGui::TextDisabled( "Hide back edges: needs a closed OBJ mesh" );
+		} else if( ImGui::Checkbox( "Hide back edges", &hiddenEdges ) ) {
+			recordEvent(InputEvent::make(InputEvent::Setting, kSettingHiddenEdges, hiddenEdges));
+			markDirty(kDirtyCube);
+		}
+
+		// Where the mesh is transformed; "Compare" overlays both paths.
+		bool transformChanged = ImGui::RadioButton( "CPU transform", &transformMode, kCpuTransform );
+		transformChanged |= ImGui::RadioButton( "GPU transform", &transformMode, kGpuTransform );
+		transformChanged |= ImGui::RadioButton( "Compare", &transformMode, kCompareTransforms );
+		if (transformChanged) {
+			recordEvent(InputEvent::make(InputEvent::Setting, kSettingTransformMode,
+					transformMode));
+			markDirty(kDirtyAll);
+		}
+		if (transformMode == kCompareTransforms) {
+			ImGui::Text( "CPU only: %zu px  GPU only: %zu px", cpuOnlyPixels, gpuOnlyPixels );
+		}
+
+		// A grid of independently rotated cubes instead of the single cube.
+		int count = instanceCount;
+		if( ImGui::SliderInt( "Cube instances", &count, 0, 1000000 ) ) {
+			setInstanceCount(count);
+			recordEvent(InputEvent::make(InputEvent::Setting, kSettingInstances, count));
+		}
+		if (!instances.empty()) {
+			ImGui::Text( "Visible instances: %zu", visibleInstances.size() );
+		}
+		if (streamer.isRunning()) {
+			ImGui::Text( "Resident chunks: %zu / %zu", streamer.residentCount(),
+					streamer.chunkCount() );
+			ImGui::Text( "Chunk memory: %.1f / %.1f MB", streamer.residentBytes() / 1048576.0,
+					streamer.budgetBytes() / 1048576.0 );
+		}
+
+		// Rolling per-stage times, to find which stage a slow frame came from.
+		if( ImGui::CollapsingHeader( "Frame timing" ) ) {
+			for (int i = 0; i < int(Stage::Count); i++) {
+				const StageHistory & history = profiler.history(Stage(i));
+				char overlay[64];
+				snprintf(overlay, sizeof(overlay), "p50 %.3f  p95 %.3f  p99 %.3f ms",
+						history.percentile(0.5f), history.percentile(0.95f),
+						history.percentile(0.99f));
+				ImGui::PlotHistogram( stageName(Stage(i)), history.samples(), history.count(),
+						history.offset(), overlay, 0.0f, FLT_MAX, ImVec2(240, 40) );
+			}
+			ImGui::Text( "Lines emitted: %zu", lineCounters.emitted );
+			ImGui::Text( "Lines clipped: %zu", lineCounters.clipped );
+			ImGui::Text( "Lines rejected: %zu", lineCounters.rejected );
+			ImGui::Text( "Lines hidden: %zu", lineCounters.hidden );
+		}
+
 		for (int i = 0; i < 7; i++) {
 			ImGui::PushID( i );
                         if( ImGui::RadioButton( modes[i], &mode, i ) ) {
-                                
+                                recordEvent(InputEvent::make(InputEvent::Setting, kSettingMode, mode));
                         }
                         ImGui::PopID();
                 }
@@ -717,26 +1347,35 @@ void A2::guiLogic()
 
 //----------------------------------------------------------------------------------------
 void A2::uploadVertexDataToVbos() {
-
-	//-- Copy vertex position data into VBO, m_vbo_positions:
-	{
-		glBindBuffer(GL_ARRAY_BUFFER, m_vbo_positions);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vec2) * m_vertexData.numVertices,
-				m_vertexData.positions.data());
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		CHECK_GL_ERRORS;
+	ScopedTimer timer(profiler, Stage::Upload);
+
+	// Replace the GPU buffers when a frame outgrows them or the vertex format
+	// changed.  Growth is rare, as VertexData grows geometrically and the
+	// stream follows its capacity.
+	FrameLines & frame = m_frames[m_drawnFrame];
+	const VertexData & lines = frame.lines;
+	if (lines.numVertices > m_vertexStream.capacity() ||
+			lines.numIndices > m_vertexStream.indexCapacity() ||
+			lines.numStripIndices > m_vertexStream.stripCapacity() ||
+			lines.format != m_vertexStream.format()) {
+		m_vertexStream.allocate(GLsizei(lines.capacity()), GLsizei(lines.indexCapacity()),
+				GLsizei(lines.stripCapacity()), lines.format);
+		mapVboDataToVertexAttributeLocation();
 	}
 
-	//-- Copy vertex colour data into VBO, m_vbo_colours:
-	{
-		glBindBuffer(GL_ARRAY_BUFFER, m_vbo_colours);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vec3) * m_vertexData.numVertices,
-				m_vertexData.colours.data());
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//-- Copy the vertices and indices that changed into the next free stream
+	// region; an unchanged frame keeps drawing the region already on the GPU.
+	m_firstVertex = m_vertexStream.upload(lines, frame.vertices, frame.indices, frame.strips);
+	frame.vertices.clear();
+	frame.indices.clear();
+	frame.strips.clear();
 
-		CHECK_GL_ERRORS;
+	if (frame.instancesCulled) {
+		instanceBuffer.uploadInstances(frame.visibleInstances);
+		frame.instancesCulled = false;
 	}
+
+	CHECK_GL_ERRORS;
 }
 
 //----------------------------------------------------------------------------------------
@@ -745,27 +1384,223 @@ void A2::uploadVertexDataToVbos() {
  */
 void A2::draw()
 {
+	ScopedTimer timer(profiler, Stage::Draw);
+
+	// The next frame's lines build on the logic thread while this one, built
+	// last frame, draws and swaps.
+	beginFrameBuild();
+	if (!threadedLogic) {
+		endFrameBuild();
+	}
+	const FrameLines & frame = m_frames[m_drawnFrame];
+
 	uploadVertexDataToVbos();
 
 	glBindVertexArray(m_vao);
 
+	profiler.beginGpu();
 	m_shader.enable();
-		glDrawArrays(GL_LINES, 0, m_vertexData.numVertices);
+		// Strips first, so the viewport frame stays under the lines it
+		// clips.  Restart is only on for them: the mesh buffers' 32-bit
+		// indices may use any value.
+		if (frame.lines.numStripIndices != 0) {
+			glEnable(GL_PRIMITIVE_RESTART);
+			glPrimitiveRestartIndex(m_vertexStream.restartIndex());
+			glDrawElementsBaseVertex(GL_LINE_STRIP, frame.lines.numStripIndices,
+					m_vertexStream.indexType(), m_vertexStream.stripOffset(), m_firstVertex);
+			glDisable(GL_PRIMITIVE_RESTART);
+		}
+		glDrawElementsBaseVertex(GL_LINES, frame.lines.numIndices, m_vertexStream.indexType(),
+				m_vertexStream.indexOffset(), m_firstVertex);
 	m_shader.disable();
 
+	if (frame.transformMode != kCpuTransform) {
+		drawMeshOnGpu(frame);
+	}
+	profiler.endGpu();
+
+	if (frame.transformMode == kCompareTransforms) {
+		countComparePixels();
+	}
+
+	// Let the stream know when the GPU is done with this frame's region.
+	m_vertexStream.fence();
+
 	// Restore defaults
 	glBindVertexArray(0);
 
+	// Before the GUI is drawn over the frame.
+	if (capture.isRunning()) {
+		ScopedTimer captureTimer(profiler, Stage::Capture);
+		capture.captureFrame(m_framebufferWidth, m_framebufferHeight);
+	}
+
 	CHECK_GL_ERRORS;
 }
 
+//----------------------------------------------------------------------------------------
+/*
+ * Draws the mesh from its static buffer, transformed by the vertex shader,
+ * with the matrices the frame's lines were built with.  The GL viewport is
+ * set to the viewport rectangle, so the hardware's clipping against the
+ * view volume also clips to the viewport.
+ */
+void A2::drawMeshOnGpu(const FrameLines & frame)
+{
+	const ClipRect & rect = frame.viewport;
+	if (rect.highX <= rect.lowX || rect.highY <= rect.lowY) {
+		return;
+	}
+	float left = (rect.lowX + 1.0f) * 0.5f * m_framebufferWidth;
+	float bottom = (rect.lowY + 1.0f) * 0.5f * m_framebufferHeight;
+	float right = (rect.highX + 1.0f) * 0.5f * m_framebufferWidth;
+	float top = (rect.highY + 1.0f) * 0.5f * m_framebufferHeight;
+
+	// A fractional viewport maps clip space exactly as the CPU path does;
+	// whole pixels can shift lines by one pixel.
+	if (gl3wIsSupported(4, 1)) {
+		glViewportIndexedf(0, left, bottom, right - left, top - bottom);
+	} else {
+		glViewport(GLint(left + 0.5f), GLint(bottom + 0.5f),
+				GLsizei(right + 0.5f) - GLint(left + 0.5f),
+				GLsizei(top + 0.5f) - GLint(bottom + 0.5f));
+	}
+
+	// Wide or antialiased lines may still spill past the viewport edge.
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(GLint(left), GLint(bottom), GLsizei(right + 1.0f) - GLint(left),
+			GLsizei(top + 1.0f) - GLint(bottom));
+
+	bool compare = frame.transformMode == kCompareTransforms;
+	vec3 colour(0.0f);
+	if (compare) {
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+		colour = kGpuCompareColour;
+	}
+
+	const mat4 & viewProj = frame.viewProj;
+	const Affine & local = frame.local;
+	if (streamer.isRunning()) {
+		// Each chunk gets its own buffer as soon as it is resident, a frame
+		// before the lines built with it are drawn, and keeps it until
+		// neither the frame nor the streamer has it.
+		chunkBuffers.resize(streamer.chunkCount());
+		const vector<uint8_t> & drawn = frame.residentChunks;
+		meshShader.enable();
+		for (size_t i = 0; i < chunkBuffers.size(); i++) {
+			unique_ptr<MeshBuffer> & buffer = chunkBuffers[i];
+			bool inFrame = i < drawn.size() && drawn[i] != 0;
+			if (!buffer && streamer.isResident(i)) {
+				buffer.reset(new MeshBuffer());
+				buffer->upload(streamer.mesh(i), meshShader.getAttribLocation("position"));
+			}
+			if (buffer && !inFrame && !streamer.isResident(i)) {
+				buffer->destroy();
+				buffer.reset();
+			}
+			if (!buffer || !inFrame) {
+				continue;
+			}
+			mat4 mvp = viewProj * (local * Affine(scene.transform(i)));
+			vec3 objectColour = compare ? colour : scene.colour(i);
+			glUniformMatrix4fv(meshShader.getUniformLocation("mvp"), 1, GL_FALSE, value_ptr(mvp));
+			glUniform3fv(meshShader.getUniformLocation("colour"), 1, value_ptr(objectColour));
+			buffer->draw();
+		}
+		meshShader.disable();
+	} else if (scene.isOpen()) {
+		// One buffer holds every object; each is drawn from its own range.
+		if (!sceneUploaded) {
+			meshBuffer.upload(scene.allObjects(), meshShader.getAttribLocation("position"));
+			sceneUploaded = true;
+		}
+		meshShader.enable();
+		for (size_t i = 0; i < scene.objectCount(); i++) {
+			if (!scene.edgesValid(i)) {
+				continue;
+			}
+			mat4 mvp = viewProj * (local * Affine(scene.transform(i)));
+			vec3 objectColour = compare ? colour : scene.colour(i);
+			glUniformMatrix4fv(meshShader.getUniformLocation("mvp"), 1, GL_FALSE, value_ptr(mvp));
+			glUniform3fv(meshShader.getUniformLocation("colour"), 1, value_ptr(objectColour));
+			meshBuffer.drawEdges(scene.firstEdge(i), scene.mesh(i).edgeCount,
+					GLint(scene.firstVertex(i)));
+		}
+		meshShader.disable();
+	} else if (!frame.instanced) {
+		mat4 mvp = viewProj * local;
+		meshShader.enable();
+			glUniformMatrix4fv(meshShader.getUniformLocation("mvp"), 1, GL_FALSE, value_ptr(mvp));
+			glUniform3fv(meshShader.getUniformLocation("colour"), 1, value_ptr(colour));
+			meshBuffer.draw();
+		meshShader.disable();
+	} else {
+		instanceShader.enable();
+			glUniformMatrix4fv(instanceShader.getUniformLocation("viewProj"), 1, GL_FALSE,
+					value_ptr(viewProj));
+			mat4 localMatrix = local.toMat4();
+			glUniformMatrix4fv(instanceShader.getUniformLocation("local"), 1, GL_FALSE,
+					value_ptr(localMatrix));
+			glUniform3fv(instanceShader.getUniformLocation("colour"), 1, value_ptr(colour));
+			instanceBuffer.drawInstanced();
+		instanceShader.disable();
+	}
+
+	// Restore defaults
+	glDisable(GL_BLEND);
+	glDisable(GL_SCISSOR_TEST);
+	glViewport(0, 0, m_framebufferWidth, m_framebufferHeight);
+
+	CHECK_GL_ERRORS;
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Reads the frame back and counts pixels drawn by only one transform path:
+ * pure red is CPU only, and background plus green is GPU only.  This stalls
+ * until the GPU finishes the frame, which is acceptable in a debug mode.
+ */
+void A2::countComparePixels()
+{
+	size_t size = size_t(m_framebufferWidth) * m_framebufferHeight * 4;
+	comparePixels.resize(size);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, m_framebufferWidth, m_framebufferHeight, GL_RGBA, GL_UNSIGNED_BYTE,
+			comparePixels.data());
+
+	cpuOnlyPixels = 0;
+	gpuOnlyPixels = 0;
+	for (size_t i = 0; i < size; i += 4) {
+		unsigned char red = comparePixels[i];
+		unsigned char green = comparePixels[i + 1];
+		if (red > 230 && green < 128) {
+			cpuOnlyPixels++;
+		} else if (green > 230 && red < 128) {
+			gpuOnlyPixels++;
+		}
+	}
+}
+
 //----------------------------------------------------------------------------------------
 /*
  * Called once, after program is signaled to terminate.
  */
 void A2::cleanup()
 {
-
+	endFrameBuild();
+	capture.stop();
+	profiler.destroyGpuTimer();
+	meshBuffer.destroy();
+	instanceBuffer.destroy();
+	for (unique_ptr<MeshBuffer> & buffer : chunkBuffers) {
+		if (buffer) {
+			buffer->destroy();
+		}
+	}
+	chunkBuffers.clear();
+	m_vertexStream.destroy();
+	inputRecorder.close();
 }
 
 //----------------------------------------------------------------------------------------
@@ -776,6 +1611,7 @@ bool A2::cursorEnterWindowEvent (
 		int entered
 ) {
 	bool eventHandled(false);
+	requestFrames(kSettleFrames);
 
 	// Fill in with event handling code...
 
@@ -790,41 +1626,45 @@ bool A2::mouseMoveEvent (
 		double xPos,
 		double yPos
 ) {
+	return queueEvent(InputEvent::mouseMove(xPos, yPos));
+}
+
+//----------------------------------------------------------------------------------------
+bool A2::handleMouseMove(double xPos, double yPos)
+{
 	bool eventHandled(false);
 
 	double xDiff = xPos - oldX;
 	oldX = xPos;
 
-	if (!ImGui::IsMouseHoveringAnyWindow()) {
-		if (mode == 0) {
-			float angle = (float)(xDiff * -1); //inverse so -1
-			if (mouseLeftPressed) {
-				mat4 rot = rotate('x', angle);
-				view = rot * view;
-			}
-			if (mouseMiddlePressed) {
-				mat4 rot = rotate('y', angle);
-				view = rot * view;
+	if (!guiHovered()) {
+		// Motion from a mode switched away from this frame is applied first,
+		// so the pending totals only ever hold one mode's units.
+		if (mode != pendingMode) {
+			applyPendingInput();
+			pendingMode = mode;
+			clearPendingInput();
+		}
+		bool pressed[3] = {mouseLeftPressed, mouseMiddlePressed, mouseRightPressed};
+
+		if (mode == 0 || mode == 1 || mode == 3 || mode == 4) {
+			float amount = (float)xDiff;
+			if (mode == 0) {
+				amount = amount * -1; //inverse so -1
 			}
-			if (mouseRightPressed) {
-				mat4 rot = rotate('z', angle);
-				view = rot * view;
+			else if (mode == 1) {
+				amount = (amount * -1)/5.0f; // inverse so -1
 			}
-			eventHandled = true;
-		}
-		else if (mode == 1) {
-			float amount = ((float) (xDiff * -1))/5.0f; // inverse so -1
-			if (mouseLeftPressed) {
-				mat4 trans = translate(amount, 0.0f, 0.0f);
-				view = trans * view;
+			else if (mode == 4) {
+				amount = amount/5.0f;
 			}
-			if (mouseMiddlePressed) {
-				mat4 trans = translate(0.0f, amount, 0.0f);
-				view = trans * view;
+			for (int button = 0; button < 3; button++) {
+				if (pressed[button]) {
+					pendingMotion[button] += amount;
+				}
 			}
-			if (mouseRightPressed) {
-				mat4 trans = translate(0.0f, 0.0f, amount);
-				view = trans * view;
+			if (mouseLeftPressed || mouseMiddlePressed || mouseRightPressed) {
+				markDirty(mode < 2 ? kDirtyCamera : kDirtyModel);
 			}
 			eventHandled = true;
 		}
@@ -839,50 +1679,19 @@ bool A2::mouseMoveEvent (
 				else if (fovDegrees < 5) {
 					fovDegrees = 5;
 				}
-				createProj(fovDegrees, near, far, aspect);
 			}
 			if (mouseMiddlePressed) {
 				near = near + amount;
-				createProj(fovDegrees, near, far, aspect);
 			}
 			if (mouseRightPressed) {
 				far = far + amount;
-				createProj(fovDegrees, near, far, aspect);
+			}
+			if (mouseLeftPressed || mouseMiddlePressed || mouseRightPressed) {
+				projectionChanged = true;
+				markDirty(kDirtyCamera);
 			}
 			eventHandled = true;
 		}
-		else if (mode == 3) {
-			float angle = (float)(xDiff);
-                        if (mouseLeftPressed) {
-                                mat4 rot = rotate('x', angle);
-                                model = model * rot;
-                        }
-                        if (mouseMiddlePressed) {
-                                mat4 rot = rotate('y', angle);
-                                model = model * rot;
-                        }
-                        if (mouseRightPressed) {
-                                mat4 rot = rotate('z', angle);
-                                model = model * rot;
-                        }
-                        eventHandled = true;
-		}
-		else if (mode == 4) {
-			float amount = ((float) (xDiff))/5.0f;
-                        if (mouseLeftPressed) {
-                                mat4 trans = translate(amount, 0.0f, 0.0f);
-                                model = model * trans;
-                        }
-                        if (mouseMiddlePressed) {
-                                mat4 trans = translate(0.0f, amount, 0.0f);
-                                model = model * trans;
-                        }
-                        if (mouseRightPressed) {
-                                mat4 trans = translate(0.0f, 0.0f, amount);
-                                model = model * trans;
-                        }
-                        eventHandled = true;
-                }
 		else if (mode == 5) {
 			float amount = ((float)xDiff)/20.0f;
 			if (amount < 0.00f) {
@@ -893,17 +1702,14 @@ bool A2::mouseMoveEvent (
 			else if (amount > 0.00f) {
 				amount = amount + 1.0f;
 			}
-			if (mouseLeftPressed) {
-				mat4 sc = scale(amount, 1.0f, 1.0f);
-				modelScale = modelScale * sc;
-			}
-			if (mouseMiddlePressed) {
-				mat4 sc = scale(1.0f, amount, 1.0f);
-				modelScale = modelScale * sc;
+			for (int button = 0; button < 3; button++) {
+				if (pressed[button]) {
+					pendingMotion[button] *= amount;
+				}
 			}
-			if (mouseRightPressed) {
-				mat4 sc = scale(1.0f, 1.0f, amount);
-				modelScale = modelScale * sc;
+			// The scale is not applied to the cube's gnomon.
+			if (mouseLeftPressed || mouseMiddlePressed || mouseRightPressed) {
+				markDirty(kDirtyCube);
 			}
 			eventHandled = true;
 		}
@@ -932,6 +1738,7 @@ bool A2::mouseMoveEvent (
 				if (y < lowYBoundary) {
 					lowYBoundary = (float)y;
 				}
+				markDirty(kDirtyAll);
 			}
 		}
 	}											
@@ -948,6 +1755,12 @@ bool A2::mouseButtonInputEvent (
 		int actions,
 		int mods
 ) {
+	return queueEvent(InputEvent::make(InputEvent::MouseButton, button, actions, mods));
+}
+
+//----------------------------------------------------------------------------------------
+bool A2::handleMouseButton(int button, int actions, int mods)
+{
 	bool eventHandled(false);
 
 	if (actions == GLFW_RELEASE) {
@@ -964,7 +1777,7 @@ bool A2::mouseButtonInputEvent (
 		eventHandled = true;
 	}
 
-	if (!ImGui::IsMouseHoveringAnyWindow()) {
+	if (!guiHovered()) {
 		if (actions == GLFW_PRESS) {
 			if (button == GLFW_MOUSE_BUTTON_LEFT) {
 				mouseLeftPressed = true;
@@ -973,6 +1786,7 @@ bool A2::mouseButtonInputEvent (
 					lowXBoundary = 2;
 					highYBoundary = -2;
 					lowYBoundary = 2;
+					markDirty(kDirtyAll);
 				}
 			}
 			if (button == GLFW_MOUSE_BUTTON_RIGHT) {
@@ -997,6 +1811,7 @@ bool A2::mouseScrollEvent (
 		double yOffSet
 ) {
 	bool eventHandled(false);
+	requestFrames(kSettleFrames);
 
 	// Fill in
 
@@ -1012,6 +1827,7 @@ bool A2::windowResizeEvent (
 		int height
 ) {
 	bool eventHandled(false);
+	requestFrames(kSettleFrames);
 
 	// Fill in with event handling code...
 
@@ -1027,6 +1843,12 @@ bool A2::keyInputEvent (
 		int action,
 		int mods
 ) {
+	return queueEvent(InputEvent::make(InputEvent::Key, key, action, mods));
+}
+
+//----------------------------------------------------------------------------------------
+bool A2::handleKey(int key, int action, int mods)
+{
 	bool eventHandled(false);
 	
 	if (action == GLFW_PRESS) {
@@ -1052,7 +1874,10 @@ bool A2::keyInputEvent (
 			mode = 6;
 		}
 		else if (key == GLFW_KEY_Q) {
-			glfwSetWindowShouldClose(m_window, GL_TRUE);
+			// A replay has no window; it ends with its events.
+			if (m_window) {
+				glfwSetWindowShouldClose(m_window, GL_TRUE);
+			}
                 }
 		else if (key == GLFW_KEY_A) {
 			reset();
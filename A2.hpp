@@ -4,33 +4,113 @@
 #include "cs488-framework/OpenGLImport.hpp"
 #include "cs488-framework/ShaderProgram.hpp"
 
+#include "Affine.hpp"
+#include "Bvh.hpp"
+#include "ChunkStreamer.hpp"
+#include "ClipSpace.hpp"
+#include "FrameCapture.hpp"
+#include "FrameProfiler.hpp"
+#include "GeometryPipeline.hpp"
+#include "InputRecording.hpp"
+#include "Instances.hpp"
+#include "LineClipper.hpp"
+#include "LogicThread.hpp"
+#include "Mesh.hpp"
+#include "MeshBuffer.hpp"
+#include "SceneFile.hpp"
+#include "SoftwareRasterizer.hpp"
+#include "ThreadPool.hpp"
+#include "VertexData.hpp"
+#include "VertexStream.hpp"
+#include "VertexTransform.hpp"
+
 #include <glm/glm.hpp>
 
+#include <memory>
+#include <string>
 #include <vector>
 
-// Set a global maximum number of vertices in order to pre-allocate VBO data
-// in one shot, rather than reallocating each frame.
-const GLsizei kMaxVertices = 1000;
 
+// The objects A2 draws, in drawing order.  Each keeps its lines from the
+// last frame it was drawn in, and is only drawn again once marked dirty.
+const int kSceneObjects = 4;
+const unsigned kDirtyViewport = 1 << 0;
+const unsigned kDirtyCube = 1 << 1;
+const unsigned kDirtyWorldGnom = 1 << 2;
+const unsigned kDirtyCubeGnom = 1 << 3;
+const unsigned kDirtyAll = (1 << kSceneObjects) - 1;
 
-// Convenience class for storing vertex data in CPU memory.
-// Data should be copied over to GPU memory via VBO storage before rendering.
-class VertexData {
-public:
-	VertexData();
 
-	std::vector<glm::vec2> positions;
-	std::vector<glm::vec3> colours;
-	GLuint index;
-	GLsizei numVertices;
+// One frame's lines, and the state they were built from, which draw() also
+// uses for the GPU path so both show the same frame.
+struct FrameLines {
+	FrameLines();
+
+	VertexData lines;
+	unsigned staleObjects;  // Objects that changed since "lines" was assembled
+
+	// What changed since the frame before, for the upload.
+	ChangedRange vertices;
+	ChangedRange indices;
+	ChangedRange strips;
+
+	int transformMode;
+	glm::mat4 viewProj;
+	Affine local;
+	ClipRect viewport;
+
+	// The visible instances' transforms, when the cube was culled again for
+	// this frame and the GPU path draws it.
+	std::vector<Affine> visibleInstances;
+	bool instancesCulled;
+
+	// What the GPU path draws: the instance grid or the single cube, and
+	// which streamed chunks were resident when the lines were built.
+	bool instanced;
+	std::vector<uint8_t> residentChunks;
 };
 
 
 class A2 : public CS488Window {
 public:
-	A2();
+	A2(const std::string & meshFile = "");
 	virtual ~A2();
 
+	// Renders "views" frames to image files without a window; see A2.cpp.
+	bool renderHeadless(const std::string & imagePath, int width, int height, int views);
+
+	// Draws a grid of this many independently rotated cubes instead of the
+	// single cube; 0 goes back to the single cube.
+	void setInstanceCount(int count);
+
+	// Streams a scene file's objects as chunks, keeping at most this many
+	// bytes resident; 0, the default, maps the whole scene.  Call before the
+	// scene is opened.
+	void setStreamBudget(size_t bytes);
+
+	// Records this session's input to a file, for replayInput().
+	bool recordInput(const std::string & eventPath);
+
+	// Plays a recorded session back without a window.  Events are fed in
+	// by their timestamps at a fixed step of frameStep seconds per frame,
+	// and each frame is rendered as in renderHeadless(); per-frame timings
+	// go to standard output as CSV.  The last frame is written to
+	// imagePath, unless it is empty.
+	bool replayInput(const std::string & eventPath, const std::string & imagePath,
+			int width, int height, float frameStep);
+
+	// Draws frames only after input or a change to the scene, and otherwise
+	// sleeps in the window's event wait.
+	void setOnDemand(bool enabled);
+
+	// Asks for at least this many more frames when drawing on demand, for
+	// anything that changes the picture without input.
+	void requestFrames(int frames);
+
+	// Writes every frame drawn in the window to "path", without the GUI;
+	// see FrameCapture for the formats.  Call before launching the window.
+	void captureFrames(const std::string & path);
+
 protected:
 	virtual void init() override;
 	virtual void appLogic() override;
@@ -51,6 +131,7 @@ protected:
 	void mapVboDataToVertexAttributeLocation();
 	void uploadVertexDataToVbos();
 
+	void initScene();
 	void initLineData();
 
 	void setLineColour(const glm::vec3 & colour);
@@ -60,43 +141,93 @@ protected:
 			const glm::vec2 & v1
 	);
 
+	// A polyline through NDC points, in the current colour, clipped to the
+	// viewport.  Corners are shared by the lines on either side, and the
+	// strip is only split where clipping cuts it.
+	void beginStrip();
+	void stripVertex(const glm::vec2 & point);
+	void endStrip();
+
 	ShaderProgram m_shader;
 
 	GLuint m_vao;            // Vertex Array Object
-	GLuint m_vbo_positions;  // Vertex Buffer Object
-	GLuint m_vbo_colours;    // Vertex Buffer Object
 
-	VertexData m_vertexData;
+	VertexStream m_vertexStream;  // Position and colour Vertex Buffer Objects
+	GLint m_firstVertex;          // Start of this frame's region in the stream
+
+	// The logic thread assembles one of these while draw() draws the other,
+	// m_frames[m_drawnFrame].
+	FrameLines m_frames[2];
+	int m_drawnFrame;
 
 	glm::vec3 m_currentLineColour;
+	PackedVertex m_currentPackedColour;  // m_currentLineColour, packed once per change
+
+	// The open strip: its last point, and whether that point was emitted
+	// unclipped, so the next line can continue from it.
+	glm::vec2 m_stripPoint;
+	bool m_stripHasPoint;
+	bool m_stripJoined;
 private:
 	void reset();
+	void clearPendingInput();
+	void applyPendingInput();
+
+	bool guiHovered() const;
+	void recordEvent(InputEvent event);
+	bool queueEvent(InputEvent event);
+	void applyQueuedEvents();
+	void waitForActivity();
+	void replayEvent(const InputEvent & event);
+	void changeSetting(int setting, int value);
+
+	bool handleMouseMove(double xPos, double yPos);
+	bool handleMouseButton(int button, int actions, int mods);
+	bool handleKey(int key, int action, int mods);
+
+	void runFrameLogic();
+	void beginFrameBuild();
+	void endFrameBuild();
+	void buildLines(FrameLines & frame, unsigned dirty);
+
+	void markDirty(unsigned objects);
+	void drawObject(int object);
+	void assembleLineData(FrameLines & frame, unsigned dirty);
 
 	glm::vec2 drawProjection(glm::vec4 point);
 	
+	void drawClipSpaceLine(glm::vec4 point1, glm::vec4 point2);
         void drawCube();
 	void drawWorldGnom();
 	void drawCubeGnom();
+	void drawSceneObjects();
+	glm::vec3 sceneCamera() const;
 	void drawViewport();
+	void drawMeshOnGpu(const FrameLines & frame);
+	void updateInstanceBvh();
+	float instanceCullMargin() const;
+	void countComparePixels();
 
-	glm::mat4 createViewMatrix(glm::vec3 lookAt, glm::vec3 lookFrom, glm::vec3 up);	
+	Affine createViewMatrix(glm::vec3 lookAt, glm::vec3 lookFrom, glm::vec3 up);	
 	void createProj(float fovDegrees, float near, float far, float aspect);
 
-	glm::mat4 translate(float xDiff, float yDiff, float zDiff);
-	glm::mat4 rotate(char axis, float degrees);
-	glm::mat4 scale(float xScale, float yScale, float zScale);
+	Affine translate(float xDiff, float yDiff, float zDiff);
+	Affine rotate(char axis, float degrees);
+	Affine scale(float xScale, float yScale, float zScale);
 
-	bool clipZ(glm::vec4 &point1, glm::vec4 &point2);
+	ClipRect viewportRect() const;
 	bool clipXY(glm::vec2 &point1, glm::vec2 &point2);
 
 	glm::vec2 orthographicProjection(glm::vec4 point);
 	glm::vec2 projection(glm::vec4 point);
 
-	glm::mat4 worldMat;
-	glm::mat4 view;
+	// Everything but the projection is affine, so only the final multiply
+	// by proj is a full 4x4 one.
+	Affine worldMat;
+	Affine view;
 	glm::mat4 proj;
-	glm::mat4 model;
-	glm::mat4 modelScale;
+	Affine model;
+	Affine modelScale;
 	float fovDegrees;
 	float near;
 	float far;
@@ -106,9 +237,108 @@ private:
 	bool mouseMiddlePressed;
 	int mode;
 	double oldX;
+
+	// Mouse motion since the last frame, per button (left, middle, right),
+	// in pendingMode's units: summed degrees or distances, or in mode 5 a
+	// product of scale factors.  appLogic applies it once per frame.
+	int pendingMode;
+	float pendingMotion[3];
+	bool projectionChanged;
+	int rotationsApplied;  // Since view and model were last orthonormalized.
+
+	// Input recording, and the recorded GUI hover state during a replay.
+	// Window events are queued as they arrive and replayed by appLogic(),
+	// so they never change state a frame is being built from.
+	InputRecorder inputRecorder;
+	bool replaying;
+	bool replayGuiHovered;
+	std::vector<InputEvent> queuedEvents;
+
+	// Drawing on demand: frames still owed to recent input or changes before
+	// the loop may sleep.
+	bool onDemand;
+	int framesToDraw;
+
 	char* modes[7] = {"O", "N", "P", "R", "T", "S", "V"};
 	float lowXBoundary;
 	float highXBoundary;
 	float lowYBoundary;
 	float highYBoundary;
+	bool packedVertices;
+	bool threadedPipeline;
+	bool threadedLogic;
+	bool hiddenEdges;
+	VertexFormat lineFormat;  // packedVertices as of the last appLogic()
+
+	std::string meshFile;
+	Mesh cubeMesh;
+
+	// A scene file given instead of a mesh, drawn in place of the cube.
+	SceneFile scene;
+
+	std::unique_ptr<ThreadPool> threadPool;
+	GeometryPipeline pipeline;
+
+	FrameProfiler profiler;
+	LineCounters lineCounters;  // This frame's lines, all draw routines
+
+	// Retained lines per scene object, spliced into a frame's lines each frame.
+	VertexData objectLines[kSceneObjects];
+	LineCounters objectCounters[kSceneObjects];
+	size_t objectOffsets[kSceneObjects];
+	size_t objectIndexOffsets[kSceneObjects];
+	size_t objectStripOffsets[kSceneObjects];
+	unsigned dirtyObjects;
+
+	// Where drawLine and the pipeline write: the object being drawn.
+	VertexData * lineTarget;
+
+	// GPU transform path: the mesh in a static buffer, transformed by the
+	// vertex shader.  transformMode picks CPU, GPU or both for comparison.
+	ShaderProgram meshShader;
+	MeshBuffer meshBuffer;
+	bool sceneUploaded;  // meshBuffer holds the mapped scene
+	int transformMode;
+
+	// Cube instances, when instanceCount > 0.  Both paths cull them through
+	// instanceBvh when the cube is redrawn, and the GPU path re-uploads the
+	// visible ones.  The BVH holds each instance's origin and is culled with
+	// a margin for the mesh under model * modelScale, so it only changes with
+	// the instances themselves.
+	int instanceCount;
+	std::vector<Affine> instances;
+	Bvh instanceBvh;
+	float instanceReach;  // Largest row length of any instance's linear part
+	std::vector<uint32_t> visibleInstances;
+	bool visibleInstancesChanged;
+	ShaderProgram instanceShader;
+	MeshBuffer instanceBuffer;
+
+	// Streaming of the scene's chunks, when streamBudget > 0.  Declared after
+	// the scene, so it stops before the scene is unmapped.  The GPU path
+	// keeps one buffer per resident chunk.
+	size_t streamBudget;
+	ChunkStreamer streamer;
+	std::vector<std::unique_ptr<MeshBuffer>> chunkBuffers;
+
+	// Comparison results: pixels only one of the two paths drew.
+	size_t cpuOnlyPixels;
+	size_t gpuOnlyPixels;
+	std::vector<unsigned char> comparePixels;
+
+	// Frame capture to capturePath, when it is not empty.
+	std::string capturePath;
+	FrameCapture capture;
+
+	// Scratch batches reused by the draw routines each frame, so the
+	// transform stage does not allocate per object.
+	PointBatch objectPoints;
+	PointBatch clipPoints;
+
+	// Builds the next frame's lines while draw() submits the last one.
+	// beginFrameBuild() hands it the state as of the end of a frame, and
+	// nothing that state includes changes until endFrameBuild().  Declared
+	// last, so it is joined before anything its job uses is destroyed.
+	bool frameBuilding;
+	LogicThread logicThread;
 };
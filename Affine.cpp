@@ -0,0 +1,191 @@
+#include "Affine.hpp"
+
+#include <cmath>
+using namespace std;
+
+using namespace glm;
+
+//----------------------------------------------------------------------------------------
+// Constructor
+Affine::Affine()
+{
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 4; c++) {
+			rows[r][c] = (r == c) ? 1.0f : 0.0f;
+		}
+	}
+}
+
+//----------------------------------------------------------------------------------------
+// Constructor
+Affine::Affine(const mat4 & m)
+{
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 4; c++) {
+			rows[r][c] = m[c][r];
+		}
+	}
+}
+
+//----------------------------------------------------------------------------------------
+Affine Affine::translation(float x, float y, float z)
+{
+	Affine a;
+	a.rows[0][3] = x;
+	a.rows[1][3] = y;
+	a.rows[2][3] = z;
+	return a;
+}
+
+//----------------------------------------------------------------------------------------
+Affine Affine::scaling(float x, float y, float z)
+{
+	Affine a;
+	a.rows[0][0] = x;
+	a.rows[1][1] = y;
+	a.rows[2][2] = z;
+	return a;
+}
+
+//----------------------------------------------------------------------------------------
+Affine Affine::rotation(char axis, float degrees)
+{
+	Affine a;
+	if (axis != 'x' && axis != 'y' && axis != 'z') {
+		return a;
+	}
+	float c = cos(radians(degrees));
+	float s = sin(radians(degrees));
+
+	// The two axes other than the rotation axis, in right-handed order.
+	int i = (axis == 'x') ? 1 : (axis == 'y') ? 2 : 0;
+	int j = (axis == 'x') ? 2 : (axis == 'y') ? 0 : 1;
+
+	a.rows[i][i] = c;
+	a.rows[i][j] = -s;
+	a.rows[j][i] = s;
+	a.rows[j][j] = c;
+	return a;
+}
+
+//----------------------------------------------------------------------------------------
+Affine Affine::operator*(const Affine & b) const
+{
+	// The implied bottom rows drop out: no terms multiply by 0 or 1.
+	Affine result;
+	for (int r = 0; r < 3; r++) {
+		const float * a = rows[r];
+		for (int c = 0; c < 3; c++) {
+			result.rows[r][c] = a[0] * b.rows[0][c] + a[1] * b.rows[1][c] + a[2] * b.rows[2][c];
+		}
+		result.rows[r][3] = a[0] * b.rows[0][3] + a[1] * b.rows[1][3] + a[2] * b.rows[2][3] +
+				a[3];
+	}
+	return result;
+}
+
+//----------------------------------------------------------------------------------------
+bool Affine::operator==(const Affine & b) const
+{
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 4; c++) {
+			if (rows[r][c] != b.rows[r][c]) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------------------
+bool Affine::operator!=(const Affine & b) const
+{
+	return !(*this == b);
+}
+
+//----------------------------------------------------------------------------------------
+vec4 Affine::operator*(const vec4 & point) const
+{
+	vec4 result;
+	for (int r = 0; r < 3; r++) {
+		result[r] = rows[r][0] * point[0] + rows[r][1] * point[1] + rows[r][2] * point[2] +
+				rows[r][3] * point[3];
+	}
+	result[3] = point[3];
+	return result;
+}
+
+//----------------------------------------------------------------------------------------
+Affine Affine::inverse() const
+{
+	// The linear part's inverse is its adjugate over its determinant; the
+	// translation is then undone in the inverted frame.
+	const float (*m)[4] = rows;
+	float cofactor[3][3];
+	for (int r = 0; r < 3; r++) {
+		int r1 = (r + 1) % 3;
+		int r2 = (r + 2) % 3;
+		for (int c = 0; c < 3; c++) {
+			int c1 = (c + 1) % 3;
+			int c2 = (c + 2) % 3;
+			cofactor[r][c] = m[r1][c1] * m[r2][c2] - m[r1][c2] * m[r2][c1];
+		}
+	}
+	float det = m[0][0] * cofactor[0][0] + m[0][1] * cofactor[0][1] + m[0][2] * cofactor[0][2];
+	float scale = 1.0f / det;
+
+	Affine result;
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 3; c++) {
+			result.rows[r][c] = cofactor[c][r] * scale;
+		}
+	}
+	for (int r = 0; r < 3; r++) {
+		result.rows[r][3] = -(result.rows[r][0] * m[0][3] + result.rows[r][1] * m[1][3] +
+				result.rows[r][2] * m[2][3]);
+	}
+	return result;
+}
+
+//----------------------------------------------------------------------------------------
+Affine Affine::orthonormalized() const
+{
+	vec3 x(rows[0][0], rows[0][1], rows[0][2]);
+	vec3 y(rows[1][0], rows[1][1], rows[1][2]);
+	x = normalize(x);
+	y = normalize(y - x * dot(x, y));
+	vec3 z = cross(x, y);
+
+	Affine result(*this);
+	for (int c = 0; c < 3; c++) {
+		result.rows[0][c] = x[c];
+		result.rows[1][c] = y[c];
+		result.rows[2][c] = z[c];
+	}
+	return result;
+}
+
+//----------------------------------------------------------------------------------------
+mat4 Affine::toMat4() const
+{
+	mat4 m(1.0f);
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 4; c++) {
+			m[c][r] = rows[r][c];
+		}
+	}
+	return m;
+}
+
+//----------------------------------------------------------------------------------------
+mat4 operator*(const mat4 & m, const Affine & a)
+{
+	// Column c of the result is m applied to column c of a, whose fourth
+	// entry is 0 for the linear columns and 1 for the translation.
+	mat4 result;
+	for (int c = 0; c < 3; c++) {
+		result[c] = m[0] * a.rows[0][c] + m[1] * a.rows[1][c] + m[2] * a.rows[2][c];
+	}
+	result[3] = m[0] * a.rows[0][3] + m[1] * a.rows[1][3] + m[2] * a.rows[2][3] + m[3];
+	return result;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Affine transform stored as the top three rows of a 4x4 matrix, whose
+// bottom row is always 0 0 0 1.  Composing two costs 36 multiplies instead
+// of a 4x4 product's 64, and applying one to a point 9 instead of 16.
+//
+// Rows are contiguous, so a vector of these uploads as one mat3x4 vertex
+// attribute per instance: see InstanceVertexShader.vs.
+struct Affine {
+	// Identity.
+	Affine();
+
+	// The top three rows of "m"; its bottom row is assumed to be 0 0 0 1.
+	explicit Affine(const glm::mat4 & m);
+
+	static Affine translation(float x, float y, float z);
+	static Affine scaling(float x, float y, float z);
+
+	// Rotation about the 'x', 'y' or 'z' axis, counterclockwise looking down
+	// the axis; sin and cos are each evaluated once.
+	static Affine rotation(char axis, float degrees);
+
+	// Composition: (a * b) applies b first.
+	Affine operator*(const Affine & b) const;
+
+	bool operator==(const Affine & b) const;
+	bool operator!=(const Affine & b) const;
+
+	// The transformed point, with "w" left as it is.
+	glm::vec4 operator*(const glm::vec4 & point) const;
+
+	// Assumes the linear part is invertible.
+	Affine inverse() const;
+
+	// The nearest rotation to the linear part, by Gram-Schmidt over its
+	// rows, with the translation kept.  Undoes the drift that repeated
+	// composition of rotations builds up; assumes no scale.
+	Affine orthonormalized() const;
+
+	glm::mat4 toMat4() const;
+
+	float rows[3][4];  // rows[r][c]: the linear part in c < 3, translation in c = 3.
+};
+
+// m * a as a full matrix, for putting a projection in front of an affine
+// chain: 48 multiplies instead of 64.
+glm::mat4 operator*(const glm::mat4 & m, const Affine & a);
@@ -0,0 +1,21 @@
+#version 330
+
+in vec3 position;
+
+// One model transform per instance, advanced once per instance rather than
+// once per vertex.  Its columns are the rows of a 3x4 affine matrix, so a
+// row vector times it applies the transform.
+in mat3x4 model;
+
+uniform mat4 viewProj;
+uniform mat4 local;
+uniform vec3 colour;
+
+out vec3 f_colour;
+
+void main() {
+	vec3 world = (local * vec4(position, 1.0)) * model;
+	gl_Position = viewProj * vec4(world, 1.0);
+
+	f_colour = colour;
+}
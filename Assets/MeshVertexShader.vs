@@ -0,0 +1,16 @@
+#version 330
+
+// Object-space position; the whole transform is done here rather than on
+// the CPU, and the hardware clips against the view volume.
+in vec3 position;
+
+uniform mat4 mvp;
+uniform vec3 colour;
+
+out vec3 f_colour;
+
+void main() {
+	gl_Position = mvp * vec4(position, 1.0);
+
+	f_colour = colour;
+}
@@ -2,12 +2,14 @@
 
 in vec2 position;
 
-in vec3 colour;
+// Float vertices supply rgb (alpha defaults to 1); packed vertices supply
+// normalized RGBA8.
+in vec4 colour;
 
 out vec3 f_colour;
 
 void main() {
 	gl_Position = vec4(position, 0.0, 1.0);
 
-	f_colour = colour;
+	f_colour = colour.rgb;
 }
@@ -0,0 +1,212 @@
+#include "Bvh.hpp"
+#include "ClipSpace.hpp"
+
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+using namespace glm;
+
+namespace {
+
+Aabb merge(const Aabb & a, const Aabb & b)
+{
+	Aabb box = {glm::min(a.low, b.low), glm::max(a.high, b.high)};
+	return box;
+}
+
+vec3 centroid(const Aabb & box)
+{
+	return 0.5f * (box.low + box.high);
+}
+
+}
+
+//----------------------------------------------------------------------------------------
+Aabb transformBox(const Affine & m, const Aabb & box)
+{
+	// Centre and half extent: the centre moves with m, and each new half
+	// extent is the extents weighted by the absolute matrix entries.
+	vec3 centre = centroid(box);
+	vec3 extent = 0.5f * (box.high - box.low);
+
+	vec3 newCentre = vec3(m * vec4(centre, 1.0f));
+	vec3 newExtent(0.0f);
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 3; c++) {
+			newExtent[r] += std::abs(m.rows[r][c]) * extent[c];
+		}
+	}
+
+	Aabb result = {newCentre - newExtent, newCentre + newExtent};
+	return result;
+}
+
+//----------------------------------------------------------------------------------------
+// Constructor
+Bvh::Bvh()
+{
+}
+
+//----------------------------------------------------------------------------------------
+void Bvh::build(const vector<Aabb> & boxes)
+{
+	m_boxes = boxes;
+	m_nodes.clear();
+	m_dirty.clear();
+	m_dirtyNodes.clear();
+
+	uint32_t count = uint32_t(boxes.size());
+	m_items.resize(count);
+	m_leafOf.resize(count);
+	for (uint32_t i = 0; i < count; i++) {
+		m_items[i] = i;
+	}
+	if (count == 0) {
+		return;
+	}
+
+	m_nodes.reserve(2 * (count / kLeafSize + 1));
+	buildNode(0, count, 0);
+	m_dirty.assign(m_nodes.size(), 0);
+}
+
+//----------------------------------------------------------------------------------------
+uint32_t Bvh::buildNode(uint32_t first, uint32_t count, uint32_t parent)
+{
+	uint32_t index = uint32_t(m_nodes.size());
+	Node node;
+	node.box = itemBounds(first, count);
+	node.first = first;
+	node.count = count;
+	node.left = 0;
+	node.right = 0;
+	node.parent = parent;
+	m_nodes.push_back(node);
+
+	if (count <= kLeafSize) {
+		for (uint32_t i = first; i < first + count; i++) {
+			m_leafOf[m_items[i]] = index;
+		}
+		return index;
+	}
+
+	// Split the items at the median centroid along the longest axis of the
+	// centroids' bounds, which keeps the tree balanced whatever the layout.
+	vec3 low = centroid(m_boxes[m_items[first]]);
+	vec3 high = low;
+	for (uint32_t i = first + 1; i < first + count; i++) {
+		vec3 c = centroid(m_boxes[m_items[i]]);
+		low = glm::min(low, c);
+		high = glm::max(high, c);
+	}
+	vec3 size = high - low;
+	int axis = (size[0] >= size[1] && size[0] >= size[2]) ? 0 : (size[1] >= size[2] ? 1 : 2);
+
+	uint32_t half = count / 2;
+	nth_element(m_items.begin() + first, m_items.begin() + first + half,
+			m_items.begin() + first + count, [&](uint32_t a, uint32_t b) {
+		return centroid(m_boxes[a])[axis] < centroid(m_boxes[b])[axis];
+	});
+
+	uint32_t left = buildNode(first, half, index);
+	uint32_t right = buildNode(first + half, count - half, index);
+	m_nodes[index].left = left;
+	m_nodes[index].right = right;
+	return index;
+}
+
+//----------------------------------------------------------------------------------------
+Aabb Bvh::itemBounds(uint32_t first, uint32_t count) const
+{
+	Aabb box = m_boxes[m_items[first]];
+	for (uint32_t i = first + 1; i < first + count; i++) {
+		box = merge(box, m_boxes[m_items[i]]);
+	}
+	return box;
+}
+
+//----------------------------------------------------------------------------------------
+size_t Bvh::size() const
+{
+	return m_boxes.size();
+}
+
+//----------------------------------------------------------------------------------------
+void Bvh::update(uint32_t item, const Aabb & box)
+{
+	m_boxes[item] = box;
+
+	// Flag the leaf and its ancestors, stopping where an earlier update
+	// already did.
+	uint32_t node = m_leafOf[item];
+	while (!m_dirty[node]) {
+		m_dirty[node] = 1;
+		m_dirtyNodes.push_back(node);
+		if (node == 0) {
+			break;
+		}
+		node = m_nodes[node].parent;
+	}
+}
+
+//----------------------------------------------------------------------------------------
+void Bvh::refit()
+{
+	// Children come after their parents, so refitting in decreasing index
+	// order sees every child's new box before its parent's.
+	sort(m_dirtyNodes.begin(), m_dirtyNodes.end(), greater<uint32_t>());
+	for (uint32_t index : m_dirtyNodes) {
+		Node & node = m_nodes[index];
+		if (node.left == 0) {
+			node.box = itemBounds(node.first, node.count);
+		} else {
+			node.box = merge(m_nodes[node.left].box, m_nodes[node.right].box);
+		}
+		m_dirty[index] = 0;
+	}
+	m_dirtyNodes.clear();
+}
+
+//----------------------------------------------------------------------------------------
+void Bvh::cull(const mat4 & viewProj, vector<uint32_t> & visible, float margin) const
+{
+	vec3 grow(margin);
+	visible.clear();
+	if (m_nodes.empty()) {
+		return;
+	}
+
+	m_stack.clear();
+	m_stack.push_back(0);
+	while (!m_stack.empty()) {
+		const Node & node = m_nodes[m_stack.back()];
+		m_stack.pop_back();
+
+		uint8_t allOutside;
+		uint8_t anyOutside;
+		boxOutcodes(viewProj, node.box.low - grow, node.box.high + grow, allOutside, anyOutside);
+		if (allOutside) {
+			continue;
+		}
+		if (anyOutside == 0) {
+			visible.insert(visible.end(), m_items.begin() + node.first,
+					m_items.begin() + node.first + node.count);
+			continue;
+		}
+
+		if (node.left != 0) {
+			m_stack.push_back(node.right);
+			m_stack.push_back(node.left);
+			continue;
+		}
+		for (uint32_t i = node.first; i < node.first + node.count; i++) {
+			const Aabb & box = m_boxes[m_items[i]];
+			if (!boxOutside(viewProj, box.low - grow, box.high + grow)) {
+				visible.push_back(m_items[i]);
+			}
+		}
+	}
+
+	sort(visible.begin(), visible.end());
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Affine.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Axis aligned bounding box.
+struct Aabb {
+	glm::vec3 low;
+	glm::vec3 high;
+};
+
+// Bounds of "box" after transforming it by "m".
+Aabb transformBox(const Affine & m, const Aabb & box);
+
+
+// Bounding volume hierarchy over a set of boxes, for culling whole groups
+// of objects against the view volume before any per-object work.
+//
+// Nodes are stored in a flat array in depth-first order, so a child always
+// comes after its parent, and the items under any node are contiguous in
+// the item order.  Moving items does not rebuild the tree: update() records
+// the new box and refit() recomputes only the nodes above changed items.
+class Bvh {
+public:
+	Bvh();
+
+	// Builds the tree over boxes[0, n), splitting at the median centroid
+	// along the longest axis.
+	void build(const std::vector<Aabb> & boxes);
+
+	size_t size() const;
+
+	// Sets the box of item "item"; takes effect in the tree at refit().
+	void update(uint32_t item, const Aabb & box);
+	void refit();
+
+	// Fills "visible" with the items whose boxes, transformed by "viewProj",
+	// are not entirely outside the view volume, in increasing order.  Nodes
+	// entirely inside are accepted without testing their items.  Every box,
+	// and so every node, is first grown by "margin" on all sides, for items
+	// that all reach a shared, changing distance past their boxes.
+	void cull(const glm::mat4 & viewProj, std::vector<uint32_t> & visible,
+			float margin = 0.0f) const;
+
+private:
+	static const uint32_t kLeafSize = 4;
+
+	struct Node {
+		Aabb box;
+		uint32_t first;   // Items m_items[first, first + count) lie below.
+		uint32_t count;
+		uint32_t left;    // Children; both 0 for a leaf.
+		uint32_t right;
+		uint32_t parent;
+	};
+
+	uint32_t buildNode(uint32_t first, uint32_t count, uint32_t parent);
+	Aabb itemBounds(uint32_t first, uint32_t count) const;
+
+	std::vector<Aabb> m_boxes;
+	std::vector<Node> m_nodes;
+	std::vector<uint32_t> m_items;
+	std::vector<uint32_t> m_leafOf;
+	std::vector<uint8_t> m_dirty;
+	std::vector<uint32_t> m_dirtyNodes;
+
+	// Walk stack for cull(), kept between frames.
+	mutable std::vector<uint32_t> m_stack;
+};
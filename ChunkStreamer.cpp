@@ -0,0 +1,350 @@
+#include "ChunkStreamer.hpp"
+
+#include <algorithm>
+#include <chrono>
+using namespace std;
+
+using namespace glm;
+
+namespace {
+
+size_t chunkBytes(size_t vertexCount, size_t edgeCount)
+{
+	return vertexCount * 4 * sizeof(float) + edgeCount * sizeof(Edge);
+}
+
+float distanceToBox(const vec3 & point, const Aabb & box)
+{
+	vec3 outside = glm::max(glm::max(box.low - point, point - box.high), vec3(0.0f));
+	return length(outside);
+}
+
+}
+
+//----------------------------------------------------------------------------------------
+// Constructor
+ChunkStreamer::ChunkStreamer()
+	: m_scene(nullptr),
+	  m_budget(0),
+	  m_cameraVersion(0),
+	  m_settledVersion(0),
+	  m_stopping(false),
+	  m_loaderBytes(0),
+	  m_residentCount(0),
+	  m_residentBytes(0)
+{
+	for (int axis = 0; axis < 3; axis++) {
+		m_camera[axis] = 0.0f;
+	}
+}
+
+//----------------------------------------------------------------------------------------
+// Destructor
+ChunkStreamer::~ChunkStreamer()
+{
+	stop();
+}
+
+//----------------------------------------------------------------------------------------
+void ChunkStreamer::start(const SceneFile & scene, size_t budgetBytes)
+{
+	stop();
+
+	m_scene = &scene;
+	m_budget = budgetBytes;
+
+	// Everything the loader needs to pick chunks comes from the object
+	// table, so nothing here touches vertex pages.
+	size_t count = scene.objectCount();
+	m_boxes.resize(count);
+	m_sizes.resize(count);
+	m_order.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		Aabb box;
+		scene.bounds(i, box.low, box.high);
+		m_boxes[i] = transformBox(Affine(scene.transform(i)), box);
+		MeshView view = scene.mesh(i);
+		m_sizes[i] = chunkBytes(view.vertices.count, view.edgeCount);
+		m_order[i] = uint32_t(i);
+	}
+
+	// The loader retries when the delivery queue is full; the render thread
+	// keeps what does not fit in the retired queue until the next frame.
+	size_t capacity = max<size_t>(64, count);
+	m_deliveries.reset(new SpscQueue<Delivery>(capacity));
+	m_retired.reset(new SpscQueue<Mesh *>(capacity));
+
+	m_wanted.assign(count, 0);
+	m_sent.assign(count, 0);
+	m_loaderBytes = 0;
+	m_resident.assign(count, nullptr);
+	m_unretired.clear();
+	m_residentCount = 0;
+	m_residentBytes = 0;
+
+	m_cameraVersion = 1;
+	m_settledVersion = 0;
+	m_stopping = false;
+	m_loader = thread(&ChunkStreamer::loaderLoop, this);
+}
+
+//----------------------------------------------------------------------------------------
+void ChunkStreamer::stop()
+{
+	if (!m_loader.joinable()) {
+		return;
+	}
+	m_stopping = true;
+	m_wake.notify_one();
+	m_loader.join();
+
+	// Both threads are done with the queues; free whatever is left in them.
+	Delivery delivery;
+	while (m_deliveries->pop(delivery)) {
+		delete delivery.mesh;
+	}
+	Mesh * mesh;
+	while (m_retired->pop(mesh)) {
+		delete mesh;
+	}
+	for (Mesh * resident : m_resident) {
+		delete resident;
+	}
+	for (Mesh * unretired : m_unretired) {
+		delete unretired;
+	}
+
+	m_resident.clear();
+	m_unretired.clear();
+	m_residentCount = 0;
+	m_residentBytes = 0;
+	m_deliveries.reset();
+	m_retired.reset();
+	m_scene = nullptr;
+}
+
+//----------------------------------------------------------------------------------------
+bool ChunkStreamer::isRunning() const
+{
+	return m_scene != nullptr;
+}
+
+//----------------------------------------------------------------------------------------
+bool ChunkStreamer::update(const vec3 & camera)
+{
+	if (!isRunning()) {
+		return false;
+	}
+
+	// Only wake the loader when there is something new to sort by.
+	if (camera[0] != m_camera[0] || camera[1] != m_camera[1] || camera[2] != m_camera[2]) {
+		for (int axis = 0; axis < 3; axis++) {
+			m_camera[axis].store(camera[axis], memory_order_relaxed);
+		}
+		m_cameraVersion.fetch_add(1, memory_order_release);
+		m_wake.notify_one();
+	}
+
+	// Memory the retired queue had no room for last frame.
+	while (!m_unretired.empty() && m_retired->push(m_unretired.back())) {
+		m_unretired.pop_back();
+	}
+
+	bool changed = false;
+	Delivery delivery;
+	while (m_deliveries->pop(delivery)) {
+		Mesh * & resident = m_resident[delivery.chunk];
+		if (delivery.mesh) {
+			resident = delivery.mesh;
+			m_residentCount++;
+			m_residentBytes += m_sizes[delivery.chunk];
+		} else {
+			retire(resident);
+			resident = nullptr;
+			m_residentCount--;
+			m_residentBytes -= m_sizes[delivery.chunk];
+		}
+		changed = true;
+	}
+	return changed;
+}
+
+//----------------------------------------------------------------------------------------
+void ChunkStreamer::waitUntilSettled(const vec3 & camera)
+{
+	update(camera);
+	while (isRunning()) {
+		// Everything delivered before the loader settled is in the queue by
+		// the time the settled version is visible.
+		bool settled = isSettled();
+		update(camera);
+		if (settled) {
+			break;
+		}
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+}
+
+//----------------------------------------------------------------------------------------
+bool ChunkStreamer::isSettled() const
+{
+	return !isRunning() || m_settledVersion.load(memory_order_acquire) ==
+			m_cameraVersion.load(memory_order_acquire);
+}
+
+//----------------------------------------------------------------------------------------
+size_t ChunkStreamer::chunkCount() const
+{
+	return m_resident.size();
+}
+
+//----------------------------------------------------------------------------------------
+bool ChunkStreamer::isResident(size_t chunk) const
+{
+	return m_resident[chunk] != nullptr;
+}
+
+//----------------------------------------------------------------------------------------
+MeshView ChunkStreamer::mesh(size_t chunk) const
+{
+	return MeshView(*m_resident[chunk]);
+}
+
+//----------------------------------------------------------------------------------------
+size_t ChunkStreamer::residentCount() const
+{
+	return m_residentCount;
+}
+
+//----------------------------------------------------------------------------------------
+size_t ChunkStreamer::residentBytes() const
+{
+	return m_residentBytes;
+}
+
+//----------------------------------------------------------------------------------------
+size_t ChunkStreamer::budgetBytes() const
+{
+	return m_budget;
+}
+
+//----------------------------------------------------------------------------------------
+void ChunkStreamer::retire(Mesh * mesh)
+{
+	// Keep the order memory was released in; never block for queue room.
+	if (!m_unretired.empty() || !m_retired->push(mesh)) {
+		m_unretired.push_back(mesh);
+	}
+}
+
+//----------------------------------------------------------------------------------------
+void ChunkStreamer::loaderLoop()
+{
+	unsigned sortedVersion = 0;
+	while (!m_stopping) {
+		LoaderState state = loaderStep(sortedVersion);
+		if (state == LoaderState::Working) {
+			continue;
+		}
+
+		// Waiting for the render thread to hand memory back polls quickly;
+		// otherwise sleep until the camera moves.
+		chrono::milliseconds timeout(state == LoaderState::Waiting ? 2 : 100);
+		unique_lock<mutex> lock(m_wakeMutex);
+		m_wake.wait_for(lock, timeout, [&]() {
+			return m_stopping || m_cameraVersion.load() != sortedVersion;
+		});
+	}
+}
+
+//----------------------------------------------------------------------------------------
+ChunkStreamer::LoaderState ChunkStreamer::loaderStep(unsigned & sortedVersion)
+{
+	Mesh * retired;
+	while (m_retired->pop(retired)) {
+		m_loaderBytes -= chunkBytes(retired->vertices.size(), retired->edges.size());
+		delete retired;
+	}
+
+	// Nearest chunks first; want as many as fit in the budget together.
+	unsigned version = m_cameraVersion.load(memory_order_acquire);
+	if (version != sortedVersion) {
+		vec3 camera(m_camera[0].load(memory_order_relaxed), m_camera[1].load(memory_order_relaxed),
+				m_camera[2].load(memory_order_relaxed));
+		sort(m_order.begin(), m_order.end(), [&](uint32_t a, uint32_t b) {
+			return distanceToBox(camera, m_boxes[a]) < distanceToBox(camera, m_boxes[b]);
+		});
+		size_t total = 0;
+		for (uint32_t chunk : m_order) {
+			m_wanted[chunk] = total + m_sizes[chunk] <= m_budget;
+			if (m_wanted[chunk]) {
+				total += m_sizes[chunk];
+			}
+		}
+		sortedVersion = version;
+	}
+
+	bool evicted = false;
+	for (uint32_t chunk : m_order) {
+		if (m_sent[chunk] && !m_wanted[chunk]) {
+			Delivery eviction = {chunk, nullptr};
+			sendDelivery(eviction);
+			m_sent[chunk] = 0;
+			evicted = true;
+		}
+	}
+	if (evicted) {
+		return LoaderState::Working;
+	}
+
+	// One chunk per step, so a camera move re-sorts before the next.  A
+	// chunk with bad edges is never loaded; the scene reports it.
+	for (uint32_t chunk : m_order) {
+		if (!m_wanted[chunk] || m_sent[chunk] || !m_scene->edgesValid(chunk)) {
+			continue;
+		}
+		if (m_loaderBytes + m_sizes[chunk] > m_budget) {
+			return LoaderState::Waiting;
+		}
+		Delivery delivery = {chunk, load(chunk)};
+		m_loaderBytes += m_sizes[chunk];
+		m_sent[chunk] = 1;
+		sendDelivery(delivery);
+		return LoaderState::Working;
+	}
+
+	m_settledVersion.store(version, memory_order_release);
+	return LoaderState::Settled;
+}
+
+//----------------------------------------------------------------------------------------
+Mesh * ChunkStreamer::load(size_t chunk) const
+{
+	// Reading the mapped view here is where the I/O happens.
+	MeshView view = m_scene->mesh(chunk);
+	size_t count = view.vertices.count;
+	Mesh * mesh = new Mesh();
+	mesh->vertices.x.assign(view.vertices.x, view.vertices.x + count);
+	mesh->vertices.y.assign(view.vertices.y, view.vertices.y + count);
+	mesh->vertices.z.assign(view.vertices.z, view.vertices.z + count);
+	mesh->vertices.w.assign(view.vertices.w, view.vertices.w + count);
+	mesh->edges.assign(view.edges, view.edges + view.edgeCount);
+
+	// The copy is what counts against the budget, so the mapped pages need
+	// not stay in this process as well.
+	m_scene->release(chunk);
+	return mesh;
+}
+
+//----------------------------------------------------------------------------------------
+void ChunkStreamer::sendDelivery(const Delivery & delivery)
+{
+	while (!m_deliveries->push(delivery)) {
+		if (m_stopping) {
+			// stop() frees what is queued; this one never got there.
+			delete delivery.mesh;
+			return;
+		}
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "Bvh.hpp"
+#include "Mesh.hpp"
+#include "SceneFile.hpp"
+#include "SpscQueue.hpp"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Keeps the objects of a scene file nearest the camera resident in memory,
+// as chunks, within a byte budget.
+//
+// A loader thread picks chunks by distance from the camera, copies them out
+// of the mapped file (so any page faults land on the loader), and hands
+// them to the render thread through a lock-free queue.  Once the budget is
+// full, farther chunks are evicted to make room for nearer ones: the loader
+// sends the eviction, the render thread stops drawing the chunk and hands
+// its memory back through a second queue, and only then does the loader
+// count the bytes as free.  The render thread never waits on the loader or
+// on I/O.
+class ChunkStreamer {
+public:
+	ChunkStreamer();
+	~ChunkStreamer();
+
+	// Starts streaming the objects of "scene", which must stay open until
+	// stop().  budgetBytes caps the memory of resident chunks.
+	void start(const SceneFile & scene, size_t budgetBytes);
+	void stop();
+	bool isRunning() const;
+
+	// Render thread, once per frame.  "camera" is the eye position in the
+	// space the scene's object transforms map into.  Takes delivered and
+	// evicted chunks; returns true if the set of resident chunks changed.
+	bool update(const glm::vec3 & camera);
+
+	// Render thread: calls update() until the loader has nothing left to do
+	// for "camera".  For offline rendering, where waiting is fine.
+	void waitUntilSettled(const glm::vec3 & camera);
+
+	// True once the loader has nothing left to do for the last camera given
+	// to update(); chunks it delivered may still wait for the next update().
+	bool isSettled() const;
+
+	// Render thread: the chunks delivered so far.
+	size_t chunkCount() const;
+	bool isResident(size_t chunk) const;
+	MeshView mesh(size_t chunk) const;
+	size_t residentCount() const;
+	size_t residentBytes() const;
+	size_t budgetBytes() const;
+
+private:
+	// Loader to render thread: a loaded chunk, or an eviction if mesh is null.
+	struct Delivery {
+		uint32_t chunk;
+		Mesh * mesh;
+	};
+
+	// Working: did something, go again.  Waiting: needs the render thread
+	// to retire memory first.  Settled: done for the current camera.
+	enum class LoaderState {
+		Working,
+		Waiting,
+		Settled
+	};
+
+	void loaderLoop();
+	LoaderState loaderStep(unsigned & sortedVersion);
+	void retire(Mesh * mesh);
+	Mesh * load(size_t chunk) const;
+	void sendDelivery(const Delivery & delivery);
+
+	const SceneFile * m_scene;
+	size_t m_budget;
+	std::vector<Aabb> m_boxes;   // Chunk bounds, transformed.
+	std::vector<size_t> m_sizes; // Chunk bytes once resident.
+
+	std::thread m_loader;
+	std::unique_ptr<SpscQueue<Delivery>> m_deliveries;
+	std::unique_ptr<SpscQueue<Mesh *>> m_retired;
+
+	// The camera, written by the render thread.  A torn read only blends
+	// two nearby positions, which is harmless for ordering chunks.
+	std::atomic<float> m_camera[3];
+	std::atomic<unsigned> m_cameraVersion;
+	std::atomic<unsigned> m_settledVersion;  // Camera version the loader finished.
+	std::atomic<bool> m_stopping;
+	std::mutex m_wakeMutex;
+	std::condition_variable m_wake;
+
+	// Loader thread state.
+	std::vector<uint8_t> m_wanted;
+	std::vector<uint8_t> m_sent;
+	std::vector<uint32_t> m_order;
+	size_t m_loaderBytes;  // Everything allocated and not yet retired.
+
+	// Render thread state.
+	std::vector<Mesh *> m_resident;
+	std::vector<Mesh *> m_unretired;  // Waiting for room in m_retired.
+	size_t m_residentCount;
+	size_t m_residentBytes;
+};
@@ -0,0 +1,161 @@
+#include "ClipSpace.hpp"
+
+#include <algorithm>
+using namespace std;
+
+using namespace glm;
+
+namespace {
+
+const uint8_t kClipPlanes[] = {
+	kClipLeft, kClipRight, kClipBottom, kClipTop, kClipNear, kClipFar, kClipW
+};
+
+// Signed distance of a point from one plane; negative means outside.  Each
+// distance is linear in the point, so it can be interpolated along an edge.
+float planeDistance(uint8_t plane, const vec4 & p)
+{
+	switch (plane) {
+		case kClipLeft: return p[3] + p[0];
+		case kClipRight: return p[3] - p[0];
+		case kClipBottom: return p[3] + p[1];
+		case kClipTop: return p[3] - p[1];
+		case kClipNear: return p[3] + p[2];
+		case kClipFar: return p[3] - p[2];
+		default: return p[3] - kMinClipW;
+	}
+}
+
+}
+
+//----------------------------------------------------------------------------------------
+uint8_t outcode(const vec4 & point)
+{
+	uint8_t code = 0;
+	for (uint8_t plane : kClipPlanes) {
+		if (planeDistance(plane, point) < 0.0f) {
+			code |= plane;
+		}
+	}
+	return code;
+}
+
+//----------------------------------------------------------------------------------------
+void computeOutcodes(const PointBatch & points, vector<uint8_t> & outcodes)
+{
+	outcodes.resize(points.size());
+	computeOutcodes(points, outcodes, 0, points.size());
+}
+
+//----------------------------------------------------------------------------------------
+void computeOutcodes(const PointBatch & points, vector<uint8_t> & outcodes,
+		size_t begin, size_t end)
+{
+	const float *x = points.x.data();
+	const float *y = points.y.data();
+	const float *z = points.z.data();
+	const float *w = points.w.data();
+
+	// Written as independent compares per plane so the loop vectorizes.
+	for (size_t i = begin; i < end; i++) {
+		outcodes[i] = uint8_t(
+			((w[i] + x[i] < 0.0f) ? kClipLeft : 0) |
+			((w[i] - x[i] < 0.0f) ? kClipRight : 0) |
+			((w[i] + y[i] < 0.0f) ? kClipBottom : 0) |
+			((w[i] - y[i] < 0.0f) ? kClipTop : 0) |
+			((w[i] + z[i] < 0.0f) ? kClipNear : 0) |
+			((w[i] - z[i] < 0.0f) ? kClipFar : 0) |
+			((w[i] - kMinClipW < 0.0f) ? kClipW : 0));
+	}
+}
+
+//----------------------------------------------------------------------------------------
+void boxOutcodes(const mat4 & mvp, const vec3 & low, const vec3 & high,
+		uint8_t & allOutside, uint8_t & anyOutside)
+{
+	// The corners are mvp * (low) plus any subset of the three edge vectors.
+	vec4 origin = mvp * vec4(low, 1.0f);
+	vec4 edgeX = mvp[0] * (high[0] - low[0]);
+	vec4 edgeY = mvp[1] * (high[1] - low[1]);
+	vec4 edgeZ = mvp[2] * (high[2] - low[2]);
+
+	allOutside = 0xff;
+	anyOutside = 0;
+	for (int corner = 0; corner < 8; corner++) {
+		vec4 point = origin;
+		if (corner & 1) {
+			point += edgeX;
+		}
+		if (corner & 2) {
+			point += edgeY;
+		}
+		if (corner & 4) {
+			point += edgeZ;
+		}
+		uint8_t code = outcode(point);
+		allOutside &= code;
+		anyOutside |= code;
+	}
+}
+
+//----------------------------------------------------------------------------------------
+bool boxOutside(const mat4 & mvp, const vec3 & low, const vec3 & high)
+{
+	uint8_t allOutside;
+	uint8_t anyOutside;
+	boxOutcodes(mvp, low, high, allOutside, anyOutside);
+	return allOutside != 0;
+}
+
+//----------------------------------------------------------------------------------------
+bool clipHomogeneous(vec4 & p0, vec4 & p1, uint8_t code0, uint8_t code1)
+{
+	// Both endpoints outside the same plane: trivially rejected.
+	if (code0 & code1) {
+		return false;
+	}
+
+	uint8_t crossing = code0 | code1;
+	if (crossing == 0) {
+		return true;
+	}
+
+	// Only planes the edge actually crosses can shorten it.
+	float t0 = 0.0f;
+	float t1 = 1.0f;
+	for (uint8_t plane : kClipPlanes) {
+		if (!(crossing & plane)) {
+			continue;
+		}
+		float d0 = planeDistance(plane, p0);
+		float d1 = planeDistance(plane, p1);
+		if (d0 < 0.0f) {
+			t0 = max(t0, d0 / (d0 - d1));
+		} else if (d1 < 0.0f) {
+			t1 = min(t1, d0 / (d0 - d1));
+		}
+	}
+
+	if (t0 > t1) {
+		return false;
+	}
+
+	vec4 delta = p1 - p0;
+	if (t1 < 1.0f) {
+		p1 = p0 + t1 * delta;
+	}
+	if (t0 > 0.0f) {
+		p0 = p0 + t0 * delta;
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------------------
+vec2 projectToViewport(const vec4 & point, const ClipRect & viewport)
+{
+	float invW = 1.0f / point[3];
+	float halfWidth = 0.5f * (viewport.highX - viewport.lowX);
+	float halfHeight = 0.5f * (viewport.highY - viewport.lowY);
+	return vec2(halfWidth * (point[0] * invW + 1.0f) + viewport.lowX,
+			halfHeight * (point[1] * invW + 1.0f) + viewport.lowY);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "LineClipper.hpp"
+#include "VertexTransform.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Outcode bits, one per clip-space plane a point lies outside of.  A point is
+// inside the view volume when -w <= x, y, z <= w.
+const uint8_t kClipLeft = 1 << 0;    // x < -w
+const uint8_t kClipRight = 1 << 1;   // x > w
+const uint8_t kClipBottom = 1 << 2;  // y < -w
+const uint8_t kClipTop = 1 << 3;     // y > w
+const uint8_t kClipNear = 1 << 4;    // z < -w
+const uint8_t kClipFar = 1 << 5;     // z > w
+
+// Guard against w <= 0, which the near plane alone does not exclude when the
+// near distance is zero.  Keeps the perspective divide finite.
+const uint8_t kClipW = 1 << 6;       // w < kMinClipW
+const float kMinClipW = 1e-5f;
+
+uint8_t outcode(const glm::vec4 & point);
+
+// Outcodes for every point of a clip-space batch, so that edges sharing a
+// vertex also share its classification.
+void computeOutcodes(const PointBatch & points, std::vector<uint8_t> & outcodes);
+
+// As above, for points [begin, end) only; "outcodes" must already be sized.
+void computeOutcodes(const PointBatch & points, std::vector<uint8_t> & outcodes,
+		size_t begin, size_t end);
+
+// Outcodes of the eight corners of the box [low, high] transformed by "mvp":
+// "allOutside" is the AND of them and "anyOutside" the OR.  The box is
+// entirely outside one plane if allOutside != 0, and entirely inside the
+// view volume if anyOutside == 0.
+void boxOutcodes(const glm::mat4 & mvp, const glm::vec3 & low, const glm::vec3 & high,
+		uint8_t & allOutside, uint8_t & anyOutside);
+
+// True if the box [low, high], transformed by "mvp", lies entirely outside
+// one of the planes of the view volume.  Conservative: a box straddling a
+// corner of the volume may be kept even though nothing of it is visible.
+bool boxOutside(const glm::mat4 & mvp, const glm::vec3 & low, const glm::vec3 & high);
+
+// Clips the segment against the planes flagged in either outcode, moving its
+// endpoints along the segment in homogeneous coordinates.  Returns false if
+// nothing of the segment is inside.
+bool clipHomogeneous(glm::vec4 & p0, glm::vec4 & p1, uint8_t code0, uint8_t code1);
+
+// Perspective divide, then maps NDC [-1, 1] onto the viewport rectangle.
+// The point must be inside the view volume.
+glm::vec2 projectToViewport(const glm::vec4 & point, const ClipRect & viewport);
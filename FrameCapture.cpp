@@ -0,0 +1,355 @@
+#include "FrameCapture.hpp"
+#include "VertexStream.hpp"
+#include "cs488-framework/GlErrorCheck.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+namespace {
+
+bool hasSuffix(const string & s, const string & suffix)
+{
+	return s.size() >= suffix.size() &&
+		s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// "capture.png" becomes "capture_000042.png".
+string numberedPath(const string & path, size_t frame)
+{
+	char suffix[24];
+	snprintf(suffix, sizeof(suffix), "_%06zu", frame);
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of('/');
+	if (dot == string::npos || (slash != string::npos && dot < slash)) {
+		return path + suffix;
+	}
+	return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+}
+
+//----------------------------------------------------------------------------------------
+// Constructor
+FrameCapture::FrameCapture()
+	: m_raw(false),
+	  m_rawWidth(0),
+	  m_rawHeight(0),
+	  m_width(0),
+	  m_height(0),
+	  m_framebuffer(0),
+	  m_colour(0),
+	  m_next(0),
+	  m_frameCount(0),
+	  m_dropped(0),
+	  m_allocated(0),
+	  m_queued(0),
+	  m_stopping(false)
+{
+	for (int i = 0; i < kPixelBuffers; i++) {
+		m_readbacks[i].buffer = 0;
+		m_readbacks[i].fence = nullptr;
+		m_readbacks[i].frame = 0;
+	}
+}
+
+//----------------------------------------------------------------------------------------
+// Destructor
+FrameCapture::~FrameCapture()
+{
+	// GL objects are released in stop(), while the context still exists.
+	stopWriter();
+}
+
+//----------------------------------------------------------------------------------------
+bool FrameCapture::start(const string & path)
+{
+	stop();
+
+	m_path = path;
+	m_raw = hasSuffix(path, ".rgb");
+	if (m_raw) {
+		m_rawOut.open(path.c_str(), ios::binary);
+		if (!m_rawOut) {
+			cerr << "FrameCapture: could not create " << path << endl;
+			return false;
+		}
+		m_rawWidth = 0;
+		m_rawHeight = 0;
+	}
+
+	glGenFramebuffers(1, &m_framebuffer);
+	glGenRenderbuffers(1, &m_colour);
+	for (Readback & readback : m_readbacks) {
+		glGenBuffers(1, &readback.buffer);
+		readback.fence = nullptr;
+	}
+	m_width = 0;
+	m_height = 0;
+	m_next = 0;
+	m_frameCount = 0;
+	m_dropped = 0;
+
+	// No more frames exist than the queues hold, so pushing never fails.
+	m_filled.reset(new SpscQueue<QueuedFrame>(kQueuedFrames));
+	m_free.reset(new SpscQueue<Framebuffer *>(kQueuedFrames));
+	m_allocated = 0;
+	m_queued = 0;
+
+	m_stopping = false;
+	m_writer = thread(&FrameCapture::writerLoop, this);
+
+	CHECK_GL_ERRORS;
+	return true;
+}
+
+//----------------------------------------------------------------------------------------
+void FrameCapture::stop()
+{
+	if (!isRunning()) {
+		return;
+	}
+
+	// Everything read back so far still gets written.
+	collectAll();
+	stopWriter();
+
+	glDeleteFramebuffers(1, &m_framebuffer);
+	glDeleteRenderbuffers(1, &m_colour);
+	for (Readback & readback : m_readbacks) {
+		glDeleteBuffers(1, &readback.buffer);
+		readback.buffer = 0;
+	}
+	m_framebuffer = 0;
+	m_colour = 0;
+
+	if (m_raw) {
+		m_rawOut.close();
+		cerr << "FrameCapture: " << m_path << " holds " << m_rawWidth << "x" << m_rawHeight
+			<< " RGBA frames" << endl;
+	}
+	if (m_dropped != 0) {
+		cerr << "FrameCapture: dropped " << m_dropped << " of " << m_frameCount << " frames"
+			<< endl;
+	}
+}
+
+//----------------------------------------------------------------------------------------
+bool FrameCapture::isRunning() const
+{
+	return m_writer.joinable();
+}
+
+//----------------------------------------------------------------------------------------
+void FrameCapture::captureFrame(int width, int height)
+{
+	if (!isRunning() || width <= 0 || height <= 0) {
+		return;
+	}
+	if (width != m_width || height != m_height) {
+		resize(width, height);
+	}
+
+	// Resolving into our own framebuffer first also reads back a
+	// multisampled window.
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT,
+			GL_NEAREST);
+
+	// The buffer is only still busy when the GPU is a whole ring behind.
+	Readback & readback = m_readbacks[m_next];
+	collect(readback);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback.frame = m_frameCount++;
+	m_next = (m_next + 1) % kPixelBuffers;
+
+	// Hand on whatever the GPU has already finished, oldest first, without
+	// waiting for the rest.
+	for (int i = 0; i < kPixelBuffers; i++) {
+		Readback & oldest = m_readbacks[(m_next + i) % kPixelBuffers];
+		if (!oldest.fence) {
+			continue;
+		}
+		if (glClientWaitSync(oldest.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+			break;
+		}
+		collect(oldest);
+	}
+
+	CHECK_GL_ERRORS;
+}
+
+//----------------------------------------------------------------------------------------
+size_t FrameCapture::framesCaptured() const
+{
+	return m_frameCount;
+}
+
+//----------------------------------------------------------------------------------------
+size_t FrameCapture::framesDropped() const
+{
+	return m_dropped;
+}
+
+//----------------------------------------------------------------------------------------
+void FrameCapture::resize(int width, int height)
+{
+	// Frames read back at the old size go first.
+	collectAll();
+	m_width = width;
+	m_height = height;
+
+	glBindRenderbuffer(GL_RENDERBUFFER, m_colour);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colour);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	GLsizeiptr bytes = GLsizeiptr(width) * height * 4;
+	for (Readback & readback : m_readbacks) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Waits for a readback if it is still in flight, and queues its pixels for
+ * the writer.  Drops the frame when the writer has every frame buffer.
+ */
+void FrameCapture::collect(Readback & readback)
+{
+	if (!readback.fence) {
+		return;
+	}
+	waitForFence(readback.fence);
+
+	Framebuffer * image = nullptr;
+	if (!m_free->pop(image)) {
+		if (m_allocated == kQueuedFrames) {
+			m_dropped++;
+			return;
+		}
+		m_allocated++;
+	}
+	if (!image || image->width() != m_width || image->height() != m_height) {
+		delete image;
+		image = new Framebuffer(m_width, m_height);
+	}
+
+	// GL rows start at the bottom, Framebuffer rows at the top.
+	size_t rowBytes = size_t(m_width) * 4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	const uint8_t * pixels = static_cast<const uint8_t *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER,
+			0, GLsizeiptr(rowBytes * m_height), GL_MAP_READ_BIT));
+	if (pixels) {
+		for (int y = 0; y < m_height; y++) {
+			memcpy(&image->pixels[size_t(y) * m_width], pixels + rowBytes * (m_height - 1 - y),
+					rowBytes);
+		}
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	if (!pixels) {
+		delete image;
+		m_allocated--;
+		m_dropped++;
+		return;
+	}
+
+	QueuedFrame queued = {readback.frame, image};
+	m_filled->push(queued);
+	{
+		// Taken so the writer cannot miss the notify between its check and its wait.
+		lock_guard<mutex> lock(m_wakeMutex);
+		m_queued++;
+	}
+	m_wake.notify_one();
+}
+
+//----------------------------------------------------------------------------------------
+void FrameCapture::collectAll()
+{
+	for (int i = 0; i < kPixelBuffers; i++) {
+		collect(m_readbacks[(m_next + i) % kPixelBuffers]);
+	}
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Lets the writer finish the queued frames, then frees them all.
+ */
+void FrameCapture::stopWriter()
+{
+	if (!m_writer.joinable()) {
+		return;
+	}
+	{
+		lock_guard<mutex> lock(m_wakeMutex);
+		m_stopping = true;
+	}
+	m_wake.notify_one();
+	m_writer.join();
+
+	Framebuffer * image;
+	while (m_free->pop(image)) {
+		delete image;
+	}
+	m_filled.reset();
+	m_free.reset();
+	m_allocated = 0;
+}
+
+//----------------------------------------------------------------------------------------
+void FrameCapture::writerLoop()
+{
+	while (true) {
+		// Read first: once stop() is seen, every frame queued before it is too.
+		bool stopping = m_stopping;
+		QueuedFrame queued;
+		if (m_filled->pop(queued)) {
+			m_queued--;
+			if (!writeFrame(queued.frame, *queued.image)) {
+				m_dropped++;
+			}
+			m_free->push(queued.image);
+			continue;
+		}
+		if (stopping) {
+			return;
+		}
+		unique_lock<mutex> lock(m_wakeMutex);
+		m_wake.wait(lock, [&]() { return m_stopping || m_queued != 0; });
+	}
+}
+
+//----------------------------------------------------------------------------------------
+bool FrameCapture::writeFrame(size_t frame, const Framebuffer & image)
+{
+	if (!m_raw) {
+		return image.write(numberedPath(m_path, frame));
+	}
+
+	// A raw stream has no header, so every frame must be the first's size.
+	if (m_rawWidth == 0) {
+		m_rawWidth = image.width();
+		m_rawHeight = image.height();
+	}
+	if (image.width() != m_rawWidth || image.height() != m_rawHeight) {
+		return false;
+	}
+	m_rawOut.write(reinterpret_cast<const char *>(image.pixels.data()),
+			image.pixels.size() * sizeof(uint32_t));
+	return bool(m_rawOut);
+}
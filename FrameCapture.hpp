@@ -0,0 +1,92 @@
+#pragma once
+
+#include "SoftwareRasterizer.hpp"
+#include "SpscQueue.hpp"
+
+#include "cs488-framework/OpenGLImport.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Records the frames the app draws to disk without the render thread ever
+// waiting for a readback or a file.  Each frame is resolved into an
+// offscreen framebuffer and read back into one of a ring of pixel buffer
+// objects; a fence per buffer says when the copy has finished, and only
+// then is it mapped, a frame or two later.  A writer thread turns the
+// pixels into files.
+//
+// A path ending in ".rgb" gets every frame appended as raw RGBA8 rows, top
+// row first, at the size of the first frame.  Any other path gets one image
+// per frame, PNG or PPM by extension, numbered like "capture_000042.png".
+class FrameCapture {
+public:
+	FrameCapture();
+	~FrameCapture();
+
+	// Render thread, with the GL context current.
+	bool start(const std::string & path);
+	void stop();
+	bool isRunning() const;
+
+	// Render thread: copies the frame drawn into the default framebuffer,
+	// "width" by "height" pixels.  Call once the frame is drawn, before
+	// anything that should not be captured, such as the GUI.
+	void captureFrame(int width, int height);
+
+	size_t framesCaptured() const;
+	size_t framesDropped() const;  // Writer too far behind, or a write failed
+
+private:
+	static const int kPixelBuffers = 3;
+	static const int kQueuedFrames = 8;
+
+	struct Readback {
+		GLuint buffer;
+		GLsync fence;
+		size_t frame;
+	};
+
+	void resize(int width, int height);
+	void collect(Readback & readback);
+	void collectAll();
+	void stopWriter();
+	void writerLoop();
+	bool writeFrame(size_t frame, const Framebuffer & image);
+
+	std::string m_path;
+	bool m_raw;
+	std::ofstream m_rawOut;
+	int m_rawWidth;
+	int m_rawHeight;
+
+	int m_width;
+	int m_height;
+	GLuint m_framebuffer;
+	GLuint m_colour;
+	Readback m_readbacks[kPixelBuffers];
+	int m_next;  // Oldest readback, and the one the next frame reuses
+	size_t m_frameCount;
+	std::atomic<size_t> m_dropped;
+
+	// Frames go to the writer through m_filled and come back through
+	// m_free, as in ChunkStreamer; m_allocated of them exist in all.
+	struct QueuedFrame {
+		size_t frame;
+		Framebuffer * image;
+	};
+	std::unique_ptr<SpscQueue<QueuedFrame>> m_filled;
+	std::unique_ptr<SpscQueue<Framebuffer *>> m_free;
+	int m_allocated;
+	std::atomic<int> m_queued;  // In m_filled, for the writer's wait
+
+	std::thread m_writer;
+	std::mutex m_wakeMutex;
+	std::condition_variable m_wake;
+	std::atomic<bool> m_stopping;
+};
@@ -0,0 +1,223 @@
+#include "FrameProfiler.hpp"
+
+#include <algorithm>
+using namespace std;
+
+//----------------------------------------------------------------------------------------
+const char * stageName(Stage stage)
+{
+	switch (stage) {
+	case Stage::AppLogic:
+		return "appLogic";
+	case Stage::BuildLines:
+		return "buildLines";
+	case Stage::DrawViewport:
+		return "drawViewport";
+	case Stage::DrawCube:
+		return "drawCube";
+	case Stage::DrawWorldGnom:
+		return "drawWorldGnom";
+	case Stage::DrawCubeGnom:
+		return "drawCubeGnom";
+	case Stage::Upload:
+		return "upload";
+	case Stage::Capture:
+		return "capture";
+	case Stage::Draw:
+		return "draw";
+	case Stage::Gpu:
+		return "GPU";
+	default:
+		return "?";
+	}
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Nearest rank, rounded: p = 0.5 of four samples is the third smallest.
+ */
+float percentile(vector<float> & samples, float p)
+{
+	if (samples.empty()) {
+		return 0.0f;
+	}
+	size_t last = samples.size() - 1;
+	size_t rank = min(size_t(p * float(last) + 0.5f), last);
+	nth_element(samples.begin(), samples.begin() + rank, samples.end());
+	return samples[rank];
+}
+
+//----------------------------------------------------------------------------------------
+// Constructor
+StageHistory::StageHistory()
+	: m_next(0),
+	  m_count(0)
+{
+	fill(m_samples, m_samples + kSamples, 0.0f);
+}
+
+//----------------------------------------------------------------------------------------
+void StageHistory::add(float milliseconds)
+{
+	m_samples[m_next] = milliseconds;
+	m_next = (m_next + 1) % kSamples;
+	m_count = min(m_count + 1, int(kSamples));
+}
+
+//----------------------------------------------------------------------------------------
+float StageHistory::percentile(float p) const
+{
+	if (m_count == 0) {
+		return 0.0f;
+	}
+	// Until the ring has wrapped, the samples are [0, m_count).
+	m_sorted.assign(m_samples, m_samples + m_count);
+	return ::percentile(m_sorted, p);
+}
+
+//----------------------------------------------------------------------------------------
+const float * StageHistory::samples() const
+{
+	return m_samples;
+}
+
+//----------------------------------------------------------------------------------------
+int StageHistory::count() const
+{
+	return kSamples;
+}
+
+//----------------------------------------------------------------------------------------
+int StageHistory::offset() const
+{
+	return m_next;
+}
+
+//----------------------------------------------------------------------------------------
+float StageHistory::latest() const
+{
+	return m_samples[(m_next + kSamples - 1) % kSamples];
+}
+
+//----------------------------------------------------------------------------------------
+// Constructor
+FrameProfiler::FrameProfiler()
+	: m_nextIssue(0),
+	  m_activeQuery(-1),
+	  m_gpuTimer(false)
+{
+	fill(m_queries, m_queries + kQueries, 0);
+	fill(m_pending, m_pending + kQueries, false);
+	fill(m_issued, m_issued + kQueries, 0);
+}
+
+//----------------------------------------------------------------------------------------
+void FrameProfiler::record(Stage stage, float milliseconds)
+{
+	m_histories[int(stage)].add(milliseconds);
+}
+
+//----------------------------------------------------------------------------------------
+const StageHistory & FrameProfiler::history(Stage stage) const
+{
+	return m_histories[int(stage)];
+}
+
+//----------------------------------------------------------------------------------------
+void FrameProfiler::initGpuTimer()
+{
+	glGenQueries(kQueries, m_queries);
+	fill(m_pending, m_pending + kQueries, false);
+	m_activeQuery = -1;
+	m_gpuTimer = true;
+}
+
+//----------------------------------------------------------------------------------------
+void FrameProfiler::destroyGpuTimer()
+{
+	if (m_gpuTimer) {
+		glDeleteQueries(kQueries, m_queries);
+		m_gpuTimer = false;
+	}
+}
+
+//----------------------------------------------------------------------------------------
+void FrameProfiler::beginGpu()
+{
+	if (!m_gpuTimer) {
+		return;
+	}
+	collectGpuResults();
+
+	// If the GPU is more than kQueries frames behind, skip timing this frame
+	// rather than wait for a query to come back.
+	int query = -1;
+	for (int i = 0; i < kQueries; i++) {
+		if (!m_pending[i]) {
+			query = i;
+			break;
+		}
+	}
+	m_activeQuery = query;
+	if (query >= 0) {
+		glBeginQuery(GL_TIME_ELAPSED, m_queries[query]);
+	}
+}
+
+//----------------------------------------------------------------------------------------
+void FrameProfiler::endGpu()
+{
+	if (m_activeQuery < 0) {
+		return;
+	}
+	glEndQuery(GL_TIME_ELAPSED);
+	m_pending[m_activeQuery] = true;
+	m_issued[m_activeQuery] = m_nextIssue++;
+	m_activeQuery = -1;
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Records finished queries oldest first, so the history stays in frame order
+ * however the slots were reused.  Stops at the first one still in flight.
+ */
+void FrameProfiler::collectGpuResults()
+{
+	while (true) {
+		int oldest = -1;
+		for (int i = 0; i < kQueries; i++) {
+			if (m_pending[i] && (oldest < 0 || m_issued[i] < m_issued[oldest])) {
+				oldest = i;
+			}
+		}
+		if (oldest < 0) {
+			return;
+		}
+		GLint available = 0;
+		glGetQueryObjectiv(m_queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			return;
+		}
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(m_queries[oldest], GL_QUERY_RESULT, &nanoseconds);
+		record(Stage::Gpu, float(double(nanoseconds) * 1e-6));
+		m_pending[oldest] = false;
+	}
+}
+
+//----------------------------------------------------------------------------------------
+// Constructor
+ScopedTimer::ScopedTimer(FrameProfiler & profiler, Stage stage)
+	: m_profiler(profiler),
+	  m_stage(stage),
+	  m_start(chrono::steady_clock::now())
+{
+}
+
+//----------------------------------------------------------------------------------------
+// Destructor
+ScopedTimer::~ScopedTimer()
+{
+	chrono::duration<float, milli> elapsed = chrono::steady_clock::now() - m_start;
+	m_profiler.record(m_stage, elapsed.count());
+}
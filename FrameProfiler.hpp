@@ -0,0 +1,103 @@
+#pragma once
+
+#include "cs488-framework/OpenGLImport.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Parts of a frame that are timed separately.  Stages nest: BuildLines,
+// which runs on the logic thread, includes the Draw* stages, and Gpu is
+// measured by the GL, not the CPU.
+enum class Stage {
+	AppLogic,
+	BuildLines,
+	DrawViewport,
+	DrawCube,
+	DrawWorldGnom,
+	DrawCubeGnom,
+	Upload,
+	Capture,
+	Draw,
+	Gpu,
+	Count
+};
+
+const char * stageName(Stage stage);
+
+// p in [0, 1] of "samples", which is reordered; 0 when there are none.
+float percentile(std::vector<float> & samples, float p);
+
+
+// Rolling window of the most recent samples of one stage, in milliseconds.
+class StageHistory {
+public:
+	static const int kSamples = 240;
+
+	StageHistory();
+
+	void add(float milliseconds);
+
+	// p in [0, 1]; 0 when there are no samples yet.
+	float percentile(float p) const;
+
+	// Samples in ring order, starting at offset(), for ImGui::PlotHistogram.
+	const float * samples() const;
+	int count() const;
+	int offset() const;
+	float latest() const;
+
+private:
+	float m_samples[kSamples];
+	int m_next;
+	int m_count;
+	mutable std::vector<float> m_sorted;
+};
+
+
+// Per-stage timing for the Properties window.  CPU stages are timed with
+// ScopedTimer; the GPU side uses GL_TIME_ELAPSED queries, read back a few
+// frames later so the CPU never waits for the GPU to catch up.
+class FrameProfiler {
+public:
+	FrameProfiler();
+
+	void record(Stage stage, float milliseconds);
+	const StageHistory & history(Stage stage) const;
+
+	// GL query objects; needs a current context.
+	void initGpuTimer();
+	void destroyGpuTimer();
+
+	// Bracket the draw calls of a frame.  Also collects any earlier frames'
+	// results that have become available.
+	void beginGpu();
+	void endGpu();
+
+private:
+	static const int kQueries = 4;
+
+	void collectGpuResults();
+
+	StageHistory m_histories[int(Stage::Count)];
+
+	GLuint m_queries[kQueries];
+	bool m_pending[kQueries];
+	uint64_t m_issued[kQueries];  // Issue order of the pending queries
+	uint64_t m_nextIssue;
+	int m_activeQuery;
+	bool m_gpuTimer;
+};
+
+
+// Records the time until the end of the enclosing scope against "stage".
+class ScopedTimer {
+public:
+	ScopedTimer(FrameProfiler & profiler, Stage stage);
+	~ScopedTimer();
+
+private:
+	FrameProfiler & m_profiler;
+	Stage m_stage;
+	std::chrono::steady_clock::time_point m_start;
+};
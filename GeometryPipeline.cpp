@@ -0,0 +1,455 @@
+#include "GeometryPipeline.hpp"
+
+#include <algorithm>
+using namespace std;
+
+using namespace glm;
+
+namespace {
+
+size_t batchCount(size_t count)
+{
+	return (count + kPipelineBatch - 1) / kPipelineBatch;
+}
+
+}
+
+//----------------------------------------------------------------------------------------
+void LineCounters::clear()
+{
+	emitted = 0;
+	clipped = 0;
+	rejected = 0;
+	hidden = 0;
+}
+
+//----------------------------------------------------------------------------------------
+LineCounters & LineCounters::operator+=(const LineCounters & other)
+{
+	emitted += other.emitted;
+	clipped += other.clipped;
+	rejected += other.rejected;
+	hidden += other.hidden;
+	return *this;
+}
+
+//----------------------------------------------------------------------------------------
+void GeometryPipeline::Vertices::resize(size_t count)
+{
+	clipPoints.resize(count);
+	outcodes.resize(count);
+	projected.resize(count);
+}
+
+//----------------------------------------------------------------------------------------
+// Constructor
+GeometryPipeline::Emitted::Emitted()
+	: pass(0)
+{
+}
+
+//----------------------------------------------------------------------------------------
+void GeometryPipeline::Emitted::beginPass(size_t vertexCount)
+{
+	index.resize(vertexCount);
+	stamp.resize(vertexCount, 0);
+	pass++;
+	if (pass == 0) {
+		// Wrapped: stamps from 2^32 passes ago would look current.
+		fill(stamp.begin(), stamp.end(), 0);
+		pass = 1;
+	}
+}
+
+//----------------------------------------------------------------------------------------
+// Constructor
+GeometryPipeline::GeometryPipeline()
+	: m_pool(nullptr),
+	  m_instances(nullptr),
+	  m_visible(nullptr),
+	  m_viewProj(1.0f),
+	  m_colour(0.0f),
+	  m_packedColour(packColour(vec3(0.0f))),
+	  m_hideEdges(false),
+	  m_eye(0.0f)
+{
+	ClipRect viewport = {-1.0f, 1.0f, -1.0f, 1.0f};
+	m_viewport = viewport;
+	m_counters.clear();
+}
+
+//----------------------------------------------------------------------------------------
+void GeometryPipeline::setThreadPool(ThreadPool * pool)
+{
+	m_pool = pool;
+}
+
+//----------------------------------------------------------------------------------------
+void GeometryPipeline::drawMesh(const MeshView & mesh, const mat4 & mvp,
+		const ClipRect & viewport, const vec3 & colour, VertexData & out, const vec3 * eye)
+{
+	m_mesh = mesh;
+	m_hideEdges = eye && mesh.edgeFaces;
+	m_viewport = viewport;
+	m_colour = colour;
+	m_packedColour = packColour(colour);
+	m_counters.clear();
+
+	size_t vertexCount = mesh.vertices.count;
+	size_t edgeCount = mesh.edgeCount;
+	unsigned workers = m_pool ? m_pool->workerCount() : 1;
+
+	m_vertices.resize(vertexCount);
+	m_emitted.resize(workers);
+	m_segments.resize(workers);
+
+	// Per-vertex stages: transform, outcodes and projection.
+	size_t vertexBatches = batchCount(vertexCount);
+	if (m_pool) {
+		m_pool->parallelFor(vertexBatches, [&](size_t batch, unsigned) {
+			size_t begin = batch * kPipelineBatch;
+			size_t end = min(begin + kPipelineBatch, vertexCount);
+			transformPoints(mvp, mesh.vertices, m_vertices.clipPoints, begin, end);
+			processVertices(m_vertices, begin, end);
+		});
+	} else {
+		transformPoints(mvp, mesh.vertices, m_vertices.clipPoints, 0, vertexCount);
+		processVertices(m_vertices, 0, vertexCount);
+	}
+
+	// Per-face stage: which way each face points, before any edge asks.
+	const EdgeFaces * edgeFaces = m_hideEdges ? mesh.edgeFaces : nullptr;
+	if (m_hideEdges) {
+		size_t faceCount = mesh.faceCount;
+		m_vertices.frontFaces.resize(faceCount);
+		if (m_pool) {
+			m_pool->parallelFor(batchCount(faceCount), [&](size_t batch, unsigned) {
+				size_t begin = batch * kPipelineBatch;
+				classifyFaces(m_vertices, *eye, begin, min(begin + kPipelineBatch, faceCount));
+			});
+		} else {
+			classifyFaces(m_vertices, *eye, 0, faceCount);
+		}
+	}
+
+	// Single threaded: emit straight into the frame, no chunks needed.
+	if (!m_pool) {
+		SegmentBatch & segments = m_segments[0];
+		segments.resize(edgeCount);
+		m_emitted[0].beginPass(vertexCount);
+		size_t segmentCount = collectSegments(mesh.edges, edgeFaces, edgeCount, m_vertices,
+				m_emitted[0], out, segments, 0, m_counters);
+		emitSegments(segments, segmentCount, out, m_counters);
+		return;
+	}
+
+	// Per-edge stages: each batch clips and emits into its own chunk.
+	size_t edgeBatches = batchCount(edgeCount);
+	prepareChunks(edgeBatches, out.format);
+	m_pool->parallelFor(edgeBatches, [&](size_t batch, unsigned worker) {
+		size_t begin = batch * kPipelineBatch;
+		size_t end = min(begin + kPipelineBatch, edgeCount);
+		SegmentBatch & segments = m_segments[worker];
+		segments.resize(end - begin);
+		m_emitted[worker].beginPass(vertexCount);
+		size_t segmentCount = collectSegments(mesh.edges + begin,
+				edgeFaces ? edgeFaces + begin : nullptr, end - begin, m_vertices,
+				m_emitted[worker], m_chunks[batch], segments, 0, m_chunkCounters[batch]);
+		emitSegments(segments, segmentCount, m_chunks[batch], m_chunkCounters[batch]);
+	});
+	mergeChunks(edgeBatches, out);
+}
+
+//----------------------------------------------------------------------------------------
+void GeometryPipeline::drawInstances(const MeshView & mesh, const vector<Affine> & instances,
+		const vector<uint32_t> & visible, const mat4 & viewProj, const Affine & local,
+		const ClipRect & viewport, const vec3 & colour, VertexData & out, const vec3 * eye)
+{
+	m_mesh = mesh;
+	m_hideEdges = eye && mesh.edgeFaces;
+	m_eye = eye ? *eye : vec3(0.0f);
+	m_instances = &instances;
+	m_visible = &visible;
+	m_viewProj = viewProj;
+	m_local = local;
+	m_viewport = viewport;
+	m_colour = colour;
+	m_packedColour = packColour(colour);
+	m_counters.clear();
+
+	// Culled instances never reach the vertex or edge stages.
+	m_counters.rejected += (instances.size() - visible.size()) * mesh.edgeCount;
+
+	unsigned workers = m_pool ? m_pool->workerCount() : 1;
+	m_workerVertices.resize(workers);
+	m_emitted.resize(workers);
+	m_segments.resize(workers);
+
+	// Group instances so that each task covers about kPipelineBatch edges.
+	size_t perBatch = max<size_t>(1, kPipelineBatch / max<size_t>(1, mesh.edgeCount));
+	size_t visibleCount = visible.size();
+	size_t batches = (visibleCount + perBatch - 1) / perBatch;
+
+	if (!m_pool) {
+		for (size_t batch = 0; batch < batches; batch++) {
+			size_t begin = batch * perBatch;
+			processInstances(begin, min(begin + perBatch, visibleCount), 0, out, m_counters);
+		}
+		return;
+	}
+
+	prepareChunks(batches, out.format);
+	m_pool->parallelFor(batches, [&](size_t batch, unsigned worker) {
+		size_t begin = batch * perBatch;
+		processInstances(begin, min(begin + perBatch, visibleCount), worker,
+				m_chunks[batch], m_chunkCounters[batch]);
+	});
+	mergeChunks(batches, out);
+}
+
+//----------------------------------------------------------------------------------------
+void GeometryPipeline::cullInstances(const MeshView & mesh, const vector<Affine> & instances,
+		const mat4 & viewProj, const Affine & local, vector<uint32_t> & visible)
+{
+	vec3 low;
+	vec3 high;
+	mesh.bounds(low, high);
+
+	size_t count = instances.size();
+	m_instanceVisible.resize(count);
+	auto cull = [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			m_instanceVisible[i] = !boxOutside(viewProj * (instances[i] * local), low, high);
+		}
+	};
+	if (m_pool) {
+		m_pool->parallelFor(batchCount(count), [&](size_t batch, unsigned) {
+			size_t begin = batch * kPipelineBatch;
+			cull(begin, min(begin + kPipelineBatch, count));
+		});
+	} else {
+		cull(0, count);
+	}
+
+	visible.clear();
+	for (size_t i = 0; i < count; i++) {
+		if (m_instanceVisible[i]) {
+			visible.push_back(uint32_t(i));
+		}
+	}
+}
+
+//----------------------------------------------------------------------------------------
+const LineCounters & GeometryPipeline::counters() const
+{
+	return m_counters;
+}
+
+//----------------------------------------------------------------------------------------
+void GeometryPipeline::processVertices(Vertices & vertices, size_t begin, size_t end)
+{
+	computeOutcodes(vertices.clipPoints, vertices.outcodes, begin, end);
+
+	// Vertices outside the view volume are only projected once an edge using
+	// them has been clipped.
+	for (size_t i = begin; i < end; i++) {
+		if (vertices.outcodes[i] == 0) {
+			vertices.projected[i] = projectToViewport(vertices.clipPoints.get(i), m_viewport);
+		}
+	}
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Marks faces [begin, end) of the mesh being drawn as facing "eye", which is
+ * in the mesh's own space.  Planes need not be normalized for the sign test.
+ */
+void GeometryPipeline::classifyFaces(Vertices & vertices, const vec3 & eye, size_t begin,
+		size_t end)
+{
+	const vec4 * planes = m_mesh.facePlanes;
+	for (size_t i = begin; i < end; i++) {
+		const vec4 & plane = planes[i];
+		vertices.frontFaces[i] = plane[0] * eye[0] + plane[1] * eye[1] + plane[2] * eye[2] +
+				plane[3] > 0.0f;
+	}
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Emits each edge lying wholly inside the view volume to "out" as a line
+ * between its corners' shared vertices.  Writes the part inside of each edge
+ * that needs clipping, projected onto the viewport, to "segments" from
+ * index "segmentCount" on, and returns the new count.  "segments" must have
+ * room for every edge.  With "edgeFaces", the faces of edges[i] are
+ * edgeFaces[i], and edges between two faces facing away are dropped first.
+ */
+size_t GeometryPipeline::collectSegments(const Edge * edges, const EdgeFaces * edgeFaces,
+		size_t edgeCount, const Vertices & vertices, Emitted & emitted, VertexData & out,
+		SegmentBatch & segments, size_t segmentCount, LineCounters & counters)
+{
+	const uint8_t * front = vertices.frontFaces.data();
+	for (size_t i = 0; i < edgeCount; i++) {
+		if (edgeFaces && !front[edgeFaces[i].first] && !front[edgeFaces[i].second]) {
+			counters.hidden++;
+			continue;
+		}
+
+		const Edge & edge = edges[i];
+		uint8_t code1 = vertices.outcodes[edge.a];
+		uint8_t code2 = vertices.outcodes[edge.b];
+
+		// Both endpoints beyond the same plane: never projected or 2D clipped.
+		if (code1 & code2) {
+			counters.rejected++;
+			continue;
+		}
+
+		if ((code1 | code2) == 0) {
+			GLuint a = emitVertex(vertices, edge.a, emitted, out);
+			GLuint b = emitVertex(vertices, edge.b, emitted, out);
+			out.addLine(a, b);
+			counters.emitted++;
+			continue;
+		}
+
+		vec4 point1 = vertices.clipPoints.get(edge.a);
+		vec4 point2 = vertices.clipPoints.get(edge.b);
+		if (!clipHomogeneous(point1, point2, code1, code2)) {
+			counters.rejected++;
+			continue;
+		}
+		counters.clipped++;
+		vec2 line1 = code1 ? projectToViewport(point1, m_viewport) : vertices.projected[edge.a];
+		vec2 line2 = code2 ? projectToViewport(point2, m_viewport) : vertices.projected[edge.b];
+		segments.set(segmentCount++, line1, line2);
+	}
+	return segmentCount;
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Index in "out" of a vertex inside the view volume, emitting it the first
+ * time it is asked for in the current pass.
+ */
+GLuint GeometryPipeline::emitVertex(const Vertices & vertices, uint32_t vertex,
+		Emitted & emitted, VertexData & out)
+{
+	if (emitted.stamp[vertex] != emitted.pass) {
+		// The segment clipper used to trim rounding error past the viewport
+		// edge; clamping does the same for a single point.
+		const vec2 & projected = vertices.projected[vertex];
+		vec2 position(clamp(projected[0], m_viewport.lowX, m_viewport.highX),
+				clamp(projected[1], m_viewport.lowY, m_viewport.highY));
+		emitted.stamp[vertex] = emitted.pass;
+		emitted.index[vertex] = out.addVertex(position, m_colour, m_packedColour);
+	}
+	return emitted.index[vertex];
+}
+
+//----------------------------------------------------------------------------------------
+void GeometryPipeline::emitSegments(SegmentBatch & segments, size_t segmentCount,
+		VertexData & out, LineCounters & counters)
+{
+	// The frustum sides map onto the viewport, so this batch only trims
+	// rounding error; whole registers of unclipped edges skip it cheaply.
+	segments.resize(segmentCount);
+	clipSegments(m_viewport, segments);
+
+	out.grow(out.numVertices + 2 * segmentCount);
+	out.growIndices(out.numIndices + 2 * segmentCount);
+	for (size_t i = 0; i < segmentCount; i++) {
+		if (segments.visible[i]) {
+			vec2 line1;
+			vec2 line2;
+			segments.get(i, line1, line2);
+			out.addLine(line1, line2, m_colour, m_packedColour);
+			counters.emitted++;
+		} else {
+			counters.rejected++;
+		}
+	}
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Transforms and clips visible instances [begin, end) one at a time through
+ * the worker's scratch vertices, collecting all their segments so the batch
+ * clip and emit run once for the group.
+ */
+void GeometryPipeline::processInstances(size_t begin, size_t end, unsigned worker,
+		VertexData & out, LineCounters & counters)
+{
+	const MeshView & mesh = m_mesh;
+	size_t vertexCount = mesh.vertices.count;
+	size_t edgeCount = mesh.edgeCount;
+
+	Vertices & vertices = m_workerVertices[worker];
+	Emitted & emitted = m_emitted[worker];
+	SegmentBatch & segments = m_segments[worker];
+	vertices.resize(vertexCount);
+	segments.resize((end - begin) * edgeCount);
+
+	size_t segmentCount = 0;
+	for (size_t i = begin; i < end; i++) {
+		// Affine compose, then the one full multiply with the projection.
+		Affine model = (*m_instances)[(*m_visible)[i]] * m_local;
+		mat4 mvp = m_viewProj * model;
+		transformPoints(mvp, mesh.vertices, vertices.clipPoints, 0, vertexCount);
+		processVertices(vertices, 0, vertexCount);
+
+		// Each instance sees the eye from its own side.
+		if (m_hideEdges) {
+			vertices.frontFaces.resize(mesh.faceCount);
+			classifyFaces(vertices, vec3(model.inverse() * vec4(m_eye, 1.0f)), 0,
+					mesh.faceCount);
+		}
+		emitted.beginPass(vertexCount);
+		segmentCount = collectSegments(mesh.edges, m_hideEdges ? mesh.edgeFaces : nullptr,
+				edgeCount, vertices, emitted, out, segments, segmentCount, counters);
+	}
+	emitSegments(segments, segmentCount, out, counters);
+}
+
+//----------------------------------------------------------------------------------------
+void GeometryPipeline::prepareChunks(size_t batches, VertexFormat format)
+{
+	if (m_chunks.size() < batches) {
+		m_chunks.resize(batches);
+	}
+	m_chunkCounters.resize(batches);
+	for (size_t batch = 0; batch < batches; batch++) {
+		m_chunks[batch].setFormat(format);
+		m_chunks[batch].clear();
+		m_chunkCounters[batch].clear();
+	}
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Reserves the whole range once, then lets each batch copy its chunk to its
+ * own offset.  Chunks hold lines only, never strips.
+ */
+void GeometryPipeline::mergeChunks(size_t batches, VertexData & out)
+{
+	m_offsets.resize(batches);
+	m_indexOffsets.resize(batches);
+	size_t total = out.numVertices;
+	size_t indexTotal = out.numIndices;
+	for (size_t batch = 0; batch < batches; batch++) {
+		m_offsets[batch] = total;
+		m_indexOffsets[batch] = indexTotal;
+		total += m_chunks[batch].numVertices;
+		indexTotal += m_chunks[batch].numIndices;
+		m_counters += m_chunkCounters[batch];
+	}
+	out.grow(total);
+	out.growIndices(indexTotal);
+	m_pool->parallelFor(batches, [&](size_t batch, unsigned) {
+		out.copyAt(m_offsets[batch], m_indexOffsets[batch], out.numStripIndices,
+				m_chunks[batch]);
+	});
+	out.index = GLuint(total);
+	out.numVertices = GLsizei(total);
+	out.numIndices = GLsizei(indexTotal);
+}
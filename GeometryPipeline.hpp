@@ -0,0 +1,144 @@
+#pragma once
+
+#include "Affine.hpp"
+#include "ClipSpace.hpp"
+#include "LineClipper.hpp"
+#include "Mesh.hpp"
+#include "ThreadPool.hpp"
+#include "VertexData.hpp"
+#include "VertexTransform.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Number of edges (or vertices) handed to a worker as one task.  Large enough
+// to amortize scheduling, small enough to balance across many cores.
+const size_t kPipelineBatch = 4096;
+
+
+// What happened to the lines submitted during a frame.
+struct LineCounters {
+	size_t emitted;   // Written to the vertex data, whole or trimmed.
+	size_t clipped;   // Crossed a frustum plane and had to be cut.
+	size_t rejected;  // Entirely outside the view volume or viewport.
+	size_t hidden;    // Behind the mesh: both faces beside it face away.
+
+	void clear();
+	LineCounters & operator+=(const LineCounters & other);
+};
+
+
+// Transform, clip and emit stages for indexed meshes.  Without a thread
+// pool everything runs on the calling thread; with one, vertices and edges
+// are split into fixed-size batches that the pool's workers process.  Each
+// edge batch writes its own VertexData chunk, and the chunks are then copied
+// into the frame's vertex data at precomputed offsets, in edge order, with
+// no locking.
+//
+// Output is indexed: an edge that needs no clipping refers to its corners'
+// projected vertices, each emitted once per chunk however many edges share
+// it, and only clipped endpoints become vertices of their own.
+class GeometryPipeline {
+public:
+	GeometryPipeline();
+
+	// The pool is not owned; nullptr runs single threaded.
+	void setThreadPool(ThreadPool * pool);
+
+	// Appends the visible edges of "mesh", transformed by "mvp" to clip space
+	// and mapped onto "viewport", to "out" as lines of the given colour.
+	//
+	// Given the camera position "eye" in the mesh's own space, a mesh with
+	// face adjacency also loses its hidden edges: those whose two faces both
+	// face away from the eye, dropped before clipping.
+	void drawMesh(const MeshView & mesh, const glm::mat4 & mvp, const ClipRect & viewport,
+			const glm::vec3 & colour, VertexData & out, const glm::vec3 * eye = nullptr);
+
+	// Draws "mesh" once for each instance listed in "visible", with
+	// viewProj * instances[i] * local as its transform.  The instances are
+	// handed to workers in groups of about kPipelineBatch edges.  Edges of
+	// unlisted instances count as rejected.  "eye" is as for drawMesh, but
+	// in the space the instances map into.
+	void drawInstances(const MeshView & mesh, const std::vector<Affine> & instances,
+			const std::vector<uint32_t> & visible, const glm::mat4 & viewProj,
+			const Affine & local, const ClipRect & viewport, const glm::vec3 & colour,
+			VertexData & out, const glm::vec3 * eye = nullptr);
+
+	// Fills "visible" with the indices of the instances whose bounding box
+	// is not entirely outside the view volume, in increasing order.  Tests
+	// every instance; see Bvh for large scenes.
+	void cullInstances(const MeshView & mesh, const std::vector<Affine> & instances,
+			const glm::mat4 & viewProj, const Affine & local,
+			std::vector<uint32_t> & visible);
+
+	// Line counts of the last drawMesh or drawInstances call.
+	const LineCounters & counters() const;
+
+private:
+	// Per-vertex results, shared by every edge through its indices.
+	struct Vertices {
+		void resize(size_t count);
+
+		PointBatch clipPoints;
+		std::vector<uint8_t> outcodes;
+		std::vector<glm::vec2> projected;
+		std::vector<uint8_t> frontFaces;  // Per face, when hiding edges.
+	};
+
+	// Where each mesh vertex went in the chunk being written, for entries
+	// whose stamp is the current pass.  A new pass forgets them all without
+	// touching the arrays.  One per worker.
+	struct Emitted {
+		Emitted();
+		void beginPass(size_t vertexCount);
+
+		std::vector<GLuint> index;
+		std::vector<uint32_t> stamp;
+		uint32_t pass;
+	};
+
+	void processVertices(Vertices & vertices, size_t begin, size_t end);
+	void classifyFaces(Vertices & vertices, const glm::vec3 & eye, size_t begin, size_t end);
+	size_t collectSegments(const Edge * edges, const EdgeFaces * edgeFaces, size_t edgeCount,
+			const Vertices & vertices, Emitted & emitted, VertexData & out,
+			SegmentBatch & segments, size_t segmentCount, LineCounters & counters);
+	GLuint emitVertex(const Vertices & vertices, uint32_t vertex, Emitted & emitted,
+			VertexData & out);
+	void emitSegments(SegmentBatch & segments, size_t segmentCount, VertexData & out,
+			LineCounters & counters);
+	void processInstances(size_t begin, size_t end, unsigned worker, VertexData & out,
+			LineCounters & counters);
+
+	void prepareChunks(size_t batches, VertexFormat format);
+	void mergeChunks(size_t batches, VertexData & out);
+
+	ThreadPool * m_pool;
+
+	// Inputs of the draw call in progress.
+	MeshView m_mesh;
+	const std::vector<Affine> * m_instances;
+	const std::vector<uint32_t> * m_visible;
+	glm::mat4 m_viewProj;
+	Affine m_local;
+	ClipRect m_viewport;
+	glm::vec3 m_colour;
+	PackedVertex m_packedColour;
+	bool m_hideEdges;
+	glm::vec3 m_eye;
+
+	Vertices m_vertices;
+	std::vector<uint8_t> m_instanceVisible;
+
+	// Scratch per worker and output per edge batch, kept between frames.
+	std::vector<Vertices> m_workerVertices;
+	std::vector<Emitted> m_emitted;
+	std::vector<SegmentBatch> m_segments;
+	std::vector<VertexData> m_chunks;
+	std::vector<size_t> m_offsets;
+	std::vector<size_t> m_indexOffsets;
+	std::vector<LineCounters> m_chunkCounters;
+
+	LineCounters m_counters;
+};
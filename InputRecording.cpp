@@ -0,0 +1,104 @@
+#include "InputRecording.hpp"
+
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+namespace {
+
+const char kInputMagic[4] = {'W', 'I', 'N', 'P'};
+const uint32_t kInputVersion = 1;
+
+// Little endian, as written on the machines we build for.
+struct InputHeader {
+	char magic[4];
+	uint32_t version;
+};
+
+}
+
+//----------------------------------------------------------------------------------------
+InputEvent InputEvent::mouseMove(double x, double y)
+{
+	InputEvent event = make(MouseMove, 0);
+	event.x = float(x);
+	event.y = float(y);
+	return event;
+}
+
+//----------------------------------------------------------------------------------------
+InputEvent InputEvent::make(Type type, int code, int action, int mods)
+{
+	InputEvent event;
+	memset(&event, 0, sizeof(event));
+	event.type = type;
+	event.code = code;
+	event.action = action;
+	event.mods = mods;
+	return event;
+}
+
+//----------------------------------------------------------------------------------------
+bool InputRecorder::open(const string & path)
+{
+	close();
+	m_out.open(path.c_str(), ios::binary);
+	if (!m_out) {
+		cerr << "InputRecorder: could not create " << path << endl;
+		return false;
+	}
+
+	InputHeader header;
+	memcpy(header.magic, kInputMagic, sizeof(kInputMagic));
+	header.version = kInputVersion;
+	m_out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	m_start = chrono::steady_clock::now();
+	return true;
+}
+
+//----------------------------------------------------------------------------------------
+void InputRecorder::close()
+{
+	if (m_out.is_open()) {
+		m_out.close();
+	}
+}
+
+//----------------------------------------------------------------------------------------
+bool InputRecorder::isOpen() const
+{
+	return m_out.is_open();
+}
+
+//----------------------------------------------------------------------------------------
+void InputRecorder::record(InputEvent event)
+{
+	// Buffered by the stream, so a burst of mouse motion is not a write each.
+	event.time = chrono::duration<float>(chrono::steady_clock::now() - m_start).count();
+	m_out.write(reinterpret_cast<const char *>(&event), sizeof(event));
+}
+
+//----------------------------------------------------------------------------------------
+bool loadInputEvents(const string & path, vector<InputEvent> & events)
+{
+	ifstream in(path.c_str(), ios::binary);
+	if (!in) {
+		cerr << "loadInputEvents: could not open " << path << endl;
+		return false;
+	}
+
+	InputHeader header;
+	if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+			memcmp(header.magic, kInputMagic, sizeof(kInputMagic)) != 0 ||
+			header.version != kInputVersion) {
+		cerr << "loadInputEvents: " << path << " is not an input recording" << endl;
+		return false;
+	}
+
+	events.clear();
+	InputEvent event;
+	while (in.read(reinterpret_cast<char *>(&event), sizeof(event))) {
+		events.push_back(event);
+	}
+	return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// One window event of a recorded session, with the time it arrived.
+struct InputEvent {
+	enum Type : uint32_t {
+		MouseMove,    // x, y: cursor position
+		MouseButton,  // code: button; action, mods
+		Key,          // code: key; action, mods
+		Setting,      // code: which setting, as the recording app numbers them; action: value
+		Reset         // the GUI's reset button
+	};
+
+	// flags: the mouse was over a GUI window, so the app ignored the event.
+	static const uint32_t kGuiHovered = 1;
+
+	static InputEvent mouseMove(double x, double y);
+	static InputEvent make(Type type, int code, int action = 0, int mods = 0);
+
+	float time;  // Seconds since recording started.
+	uint32_t type;
+	float x;
+	float y;
+	int32_t code;
+	int32_t action;
+	int32_t mods;
+	uint32_t flags;
+};
+
+
+// Appends events to a file as they arrive, stamped with the time since
+// open().  The file is a short header, then fixed size InputEvent records.
+class InputRecorder {
+public:
+	bool open(const std::string & path);
+	void close();
+	bool isOpen() const;
+
+	void record(InputEvent event);
+
+private:
+	std::ofstream m_out;
+	std::chrono::steady_clock::time_point m_start;
+};
+
+
+// Reads a file written by InputRecorder.  A record cut short by a crash
+// at the end of the file is dropped.
+bool loadInputEvents(const std::string & path, std::vector<InputEvent> & events);
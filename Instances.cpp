@@ -0,0 +1,53 @@
+#include "Instances.hpp"
+
+#include <cmath>
+#include <random>
+using namespace std;
+
+using namespace glm;
+
+//----------------------------------------------------------------------------------------
+vector<Affine> instanceGrid(size_t count, float spacing, unsigned seed)
+{
+	vector<Affine> instances(count);
+	if (count == 0) {
+		return instances;
+	}
+
+	size_t side = size_t(ceil(cbrt(double(count))));
+	float centre = 0.5f * float(side - 1);
+
+	mt19937 random(seed);
+	uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	uniform_real_distribution<float> turn(0.0f, 6.2831853f);
+
+	for (size_t i = 0; i < count; i++) {
+		size_t x = i % side;
+		size_t y = (i / side) % side;
+		size_t z = i / (side * side);
+
+		// Rodrigues' rotation about a random unit axis.
+		vec3 axis(unit(random), unit(random), unit(random));
+		float length = sqrt(dot(axis, axis));
+		axis = (length > 1e-4f) ? axis / length : vec3(0.0f, 1.0f, 0.0f);
+		float angle = turn(random);
+		float c = cos(angle);
+		float s = sin(angle);
+		float t = 1.0f - c;
+
+		float (*m)[4] = instances[i].rows;
+		m[0][0] = t * axis[0] * axis[0] + c;
+		m[1][0] = t * axis[0] * axis[1] + s * axis[2];
+		m[2][0] = t * axis[0] * axis[2] - s * axis[1];
+		m[0][1] = t * axis[0] * axis[1] - s * axis[2];
+		m[1][1] = t * axis[1] * axis[1] + c;
+		m[2][1] = t * axis[1] * axis[2] + s * axis[0];
+		m[0][2] = t * axis[0] * axis[2] + s * axis[1];
+		m[1][2] = t * axis[1] * axis[2] - s * axis[0];
+		m[2][2] = t * axis[2] * axis[2] + c;
+		m[0][3] = (float(x) - centre) * spacing;
+		m[1][3] = (float(y) - centre) * spacing;
+		m[2][3] = (float(z) - centre) * spacing;
+	}
+	return instances;
+}
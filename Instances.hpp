@@ -0,0 +1,11 @@
+#pragma once
+
+#include "Affine.hpp"
+
+#include <cstddef>
+#include <vector>
+
+// Model transforms for "count" copies of a mesh on a cubic grid centred on the
+// origin, "spacing" apart, each with its own rotation about a random axis.
+// Stored contiguously so that culling and the GPU upload stream through them.
+std::vector<Affine> instanceGrid(size_t count, float spacing, unsigned seed);
@@ -0,0 +1,351 @@
+#include "LineClipper.hpp"
+
+#if defined(__AVX512F__) || defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+using namespace std;
+
+using namespace glm;
+
+//----------------------------------------------------------------------------------------
+void SegmentBatch::resize(size_t count)
+{
+	x0.resize(count);
+	y0.resize(count);
+	x1.resize(count);
+	y1.resize(count);
+	visible.resize(count);
+}
+
+//----------------------------------------------------------------------------------------
+void SegmentBatch::clear()
+{
+	resize(0);
+}
+
+//----------------------------------------------------------------------------------------
+size_t SegmentBatch::size() const
+{
+	return x0.size();
+}
+
+//----------------------------------------------------------------------------------------
+void SegmentBatch::set(size_t i, const vec2 & p0, const vec2 & p1)
+{
+	x0[i] = p0[0];
+	y0[i] = p0[1];
+	x1[i] = p1[0];
+	y1[i] = p1[1];
+}
+
+//----------------------------------------------------------------------------------------
+void SegmentBatch::get(size_t i, vec2 & p0, vec2 & p1) const
+{
+	p0 = vec2(x0[i], y0[i]);
+	p1 = vec2(x1[i], y1[i]);
+}
+
+namespace {
+
+bool inside(const ClipRect & rect, float x, float y)
+{
+	return x >= rect.lowX && x <= rect.highX && y >= rect.lowY && y <= rect.highY;
+}
+
+// One Liang-Barsky boundary: p is the change along the boundary normal, q the
+// distance of the start point inside it.  Returns false if the segment runs
+// parallel to the boundary, outside it.
+bool clipBoundary(float p, float q, float & t0, float & t1)
+{
+	if (p == 0.0f) {
+		return !(q < 0.0f);
+	}
+	float r = q / p;
+	if (p < 0.0f) {
+		t0 = max(t0, r);
+	} else {
+		t1 = min(t1, r);
+	}
+	return true;
+}
+
+#if defined(__AVX512F__)
+
+struct Simd {
+	typedef __m512 Reg;
+	typedef __mmask16 Mask;
+	static const int kWidth = 16;
+
+	static Reg load(const float * p) { return _mm512_loadu_ps(p); }
+	static void store(float * p, Reg a) { _mm512_storeu_ps(p, a); }
+	static Reg set1(float a) { return _mm512_set1_ps(a); }
+	static Reg add(Reg a, Reg b) { return _mm512_add_ps(a, b); }
+	static Reg sub(Reg a, Reg b) { return _mm512_sub_ps(a, b); }
+	static Reg mul(Reg a, Reg b) { return _mm512_mul_ps(a, b); }
+	static Reg div(Reg a, Reg b) { return _mm512_div_ps(a, b); }
+	static Reg min(Reg a, Reg b) { return _mm512_min_ps(a, b); }
+	static Reg max(Reg a, Reg b) { return _mm512_max_ps(a, b); }
+	static Mask lt(Reg a, Reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+	static Mask le(Reg a, Reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+	static Mask eq(Reg a, Reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+	static Mask both(Mask a, Mask b) { return a & b; }
+	static Mask either(Mask a, Mask b) { return a | b; }
+	static Mask butNot(Mask a, Mask b) { return a & ~b; }
+	static Mask none() { return 0; }
+	static Reg select(Mask m, Reg a, Reg b) { return _mm512_mask_blend_ps(m, b, a); }
+	static int bits(Mask m) { return int(m); }
+};
+
+#elif defined(__AVX__)
+
+struct Simd {
+	typedef __m256 Reg;
+	typedef __m256 Mask;
+	static const int kWidth = 8;
+
+	static Reg load(const float * p) { return _mm256_loadu_ps(p); }
+	static void store(float * p, Reg a) { _mm256_storeu_ps(p, a); }
+	static Reg set1(float a) { return _mm256_set1_ps(a); }
+	static Reg add(Reg a, Reg b) { return _mm256_add_ps(a, b); }
+	static Reg sub(Reg a, Reg b) { return _mm256_sub_ps(a, b); }
+	static Reg mul(Reg a, Reg b) { return _mm256_mul_ps(a, b); }
+	static Reg div(Reg a, Reg b) { return _mm256_div_ps(a, b); }
+	static Reg min(Reg a, Reg b) { return _mm256_min_ps(a, b); }
+	static Reg max(Reg a, Reg b) { return _mm256_max_ps(a, b); }
+	static Mask lt(Reg a, Reg b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	static Mask le(Reg a, Reg b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	static Mask eq(Reg a, Reg b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+	static Mask both(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+	static Mask either(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+	static Mask butNot(Mask a, Mask b) { return _mm256_andnot_ps(b, a); }
+	static Mask none() { return _mm256_setzero_ps(); }
+	static Reg select(Mask m, Reg a, Reg b) { return _mm256_blendv_ps(b, a, m); }
+	static int bits(Mask m) { return _mm256_movemask_ps(m); }
+};
+
+#elif defined(__SSE2__)
+
+struct Simd {
+	typedef __m128 Reg;
+	typedef __m128 Mask;
+	static const int kWidth = 4;
+
+	static Reg load(const float * p) { return _mm_loadu_ps(p); }
+	static void store(float * p, Reg a) { _mm_storeu_ps(p, a); }
+	static Reg set1(float a) { return _mm_set1_ps(a); }
+	static Reg add(Reg a, Reg b) { return _mm_add_ps(a, b); }
+	static Reg sub(Reg a, Reg b) { return _mm_sub_ps(a, b); }
+	static Reg mul(Reg a, Reg b) { return _mm_mul_ps(a, b); }
+	static Reg div(Reg a, Reg b) { return _mm_div_ps(a, b); }
+	static Reg min(Reg a, Reg b) { return _mm_min_ps(a, b); }
+	static Reg max(Reg a, Reg b) { return _mm_max_ps(a, b); }
+	static Mask lt(Reg a, Reg b) { return _mm_cmplt_ps(a, b); }
+	static Mask le(Reg a, Reg b) { return _mm_cmple_ps(a, b); }
+	static Mask eq(Reg a, Reg b) { return _mm_cmpeq_ps(a, b); }
+	static Mask both(Mask a, Mask b) { return _mm_and_ps(a, b); }
+	static Mask either(Mask a, Mask b) { return _mm_or_ps(a, b); }
+	static Mask butNot(Mask a, Mask b) { return _mm_andnot_ps(b, a); }
+	static Mask none() { return _mm_setzero_ps(); }
+	static Reg select(Mask m, Reg a, Reg b)
+	{
+		return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+	}
+	static int bits(Mask m) { return _mm_movemask_ps(m); }
+};
+
+#endif
+
+#if defined(__AVX512F__) || defined(__AVX__) || defined(__SSE2__)
+
+// Branchless form of clipBoundary for a whole register of segments.
+inline void clipBoundaries(Simd::Reg p, Simd::Reg q, Simd::Reg & t0, Simd::Reg & t1,
+		Simd::Mask & reject)
+{
+	const Simd::Reg zero = Simd::set1(0.0f);
+
+	// Lanes with p == 0 divide by zero here, but their result is never selected.
+	Simd::Reg r = Simd::div(q, p);
+	t0 = Simd::select(Simd::lt(p, zero), Simd::max(t0, r), t0);
+	t1 = Simd::select(Simd::lt(zero, p), Simd::min(t1, r), t1);
+	reject = Simd::either(reject, Simd::both(Simd::eq(p, zero), Simd::lt(q, zero)));
+}
+
+// Clips segments [i, i + kWidth) of the batch while they fit, and returns the
+// index of the first segment left for the scalar tail.
+size_t clipSegmentsSimd(const ClipRect & rect, SegmentBatch & s, size_t count)
+{
+	const Simd::Reg zero = Simd::set1(0.0f);
+	const Simd::Reg one = Simd::set1(1.0f);
+	const Simd::Reg lowX = Simd::set1(rect.lowX);
+	const Simd::Reg highX = Simd::set1(rect.highX);
+	const Simd::Reg lowY = Simd::set1(rect.lowY);
+	const Simd::Reg highY = Simd::set1(rect.highY);
+	const int allLanes = (1 << Simd::kWidth) - 1;
+
+	size_t i = 0;
+	for (; i + Simd::kWidth <= count; i += Simd::kWidth) {
+		Simd::Reg x0 = Simd::load(&s.x0[i]);
+		Simd::Reg y0 = Simd::load(&s.y0[i]);
+		Simd::Reg x1 = Simd::load(&s.x1[i]);
+		Simd::Reg y1 = Simd::load(&s.y1[i]);
+
+		// Outcode test: if every endpoint is inside there is nothing to store.
+		Simd::Mask inside0 = Simd::both(
+				Simd::both(Simd::le(lowX, x0), Simd::le(x0, highX)),
+				Simd::both(Simd::le(lowY, y0), Simd::le(y0, highY)));
+		Simd::Mask inside1 = Simd::both(
+				Simd::both(Simd::le(lowX, x1), Simd::le(x1, highX)),
+				Simd::both(Simd::le(lowY, y1), Simd::le(y1, highY)));
+		if (Simd::bits(Simd::both(inside0, inside1)) == allLanes) {
+			fill(s.visible.begin() + i, s.visible.begin() + i + Simd::kWidth, 1);
+			continue;
+		}
+
+		Simd::Reg dx = Simd::sub(x1, x0);
+		Simd::Reg dy = Simd::sub(y1, y0);
+		Simd::Reg t0 = zero;
+		Simd::Reg t1 = one;
+		Simd::Mask reject = Simd::none();
+
+		clipBoundaries(Simd::sub(zero, dx), Simd::sub(x0, lowX), t0, t1, reject);
+		clipBoundaries(dx, Simd::sub(highX, x0), t0, t1, reject);
+		clipBoundaries(Simd::sub(zero, dy), Simd::sub(y0, lowY), t0, t1, reject);
+		clipBoundaries(dy, Simd::sub(highY, y0), t0, t1, reject);
+
+		Simd::Mask visible = Simd::butNot(Simd::le(t0, t1), reject);
+
+		// Keep endpoints that were not moved exactly as they were.
+		Simd::Mask keep0 = Simd::eq(t0, zero);
+		Simd::Mask keep1 = Simd::eq(t1, one);
+		Simd::store(&s.x0[i], Simd::select(keep0, x0, Simd::add(x0, Simd::mul(t0, dx))));
+		Simd::store(&s.y0[i], Simd::select(keep0, y0, Simd::add(y0, Simd::mul(t0, dy))));
+		Simd::store(&s.x1[i], Simd::select(keep1, x1, Simd::add(x0, Simd::mul(t1, dx))));
+		Simd::store(&s.y1[i], Simd::select(keep1, y1, Simd::add(y0, Simd::mul(t1, dy))));
+
+		int visibleBits = Simd::bits(visible);
+		for (int lane = 0; lane < Simd::kWidth; lane++) {
+			s.visible[i + lane] = uint8_t((visibleBits >> lane) & 1);
+		}
+	}
+	return i;
+}
+
+#else
+
+size_t clipSegmentsSimd(const ClipRect &, SegmentBatch &, size_t)
+{
+	return 0;
+}
+
+#endif
+
+}
+
+//----------------------------------------------------------------------------------------
+bool clipSegment(const ClipRect & rect, vec2 & p0, vec2 & p1)
+{
+	float x0 = p0[0];
+	float y0 = p0[1];
+	float x1 = p1[0];
+	float y1 = p1[1];
+
+	if (inside(rect, x0, y0) && inside(rect, x1, y1)) {
+		return true;
+	}
+
+	float dx = x1 - x0;
+	float dy = y1 - y0;
+	float t0 = 0.0f;
+	float t1 = 1.0f;
+
+	if (!clipBoundary(-dx, x0 - rect.lowX, t0, t1) ||
+			!clipBoundary(dx, rect.highX - x0, t0, t1) ||
+			!clipBoundary(-dy, y0 - rect.lowY, t0, t1) ||
+			!clipBoundary(dy, rect.highY - y0, t0, t1) ||
+			t0 > t1) {
+		return false;
+	}
+
+	if (t0 != 0.0f) {
+		p0 = vec2(x0 + t0 * dx, y0 + t0 * dy);
+	}
+	if (t1 != 1.0f) {
+		p1 = vec2(x0 + t1 * dx, y0 + t1 * dy);
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------------------
+void clipSegments(const ClipRect & rect, SegmentBatch & segments)
+{
+	size_t count = segments.size();
+	size_t i = clipSegmentsSimd(rect, segments, count);
+
+	for (; i < count; i++) {
+		vec2 p0;
+		vec2 p1;
+		segments.get(i, p0, p1);
+		segments.visible[i] = clipSegment(rect, p0, p1) ? 1 : 0;
+		segments.set(i, p0, p1);
+	}
+}
+
+//----------------------------------------------------------------------------------------
+size_t verifyLineClipper(size_t count, unsigned seed)
+{
+	mt19937 random(seed);
+	uniform_real_distribution<float> coordinate(-2.0f, 2.0f);
+	uniform_int_distribution<int> shape(0, 7);
+
+	ClipRect rect = {-0.9f, 0.7f, -0.6f, 0.9f};
+	SegmentBatch batch;
+	batch.resize(count);
+
+	for (size_t i = 0; i < count; i++) {
+		vec2 p0(coordinate(random), coordinate(random));
+		vec2 p1(coordinate(random), coordinate(random));
+		switch (shape(random)) {
+			case 0: p1[0] = p0[0]; break;      // vertical
+			case 1: p1[1] = p0[1]; break;      // horizontal
+			case 2: p1 = p0; break;            // degenerate
+			case 3: p0[0] = rect.lowX; break;  // on a boundary
+			default: break;
+		}
+		batch.set(i, p0, p1);
+	}
+
+	SegmentBatch reference = batch;
+	clipSegments(rect, batch);
+
+	// Allow for rounding differences, e.g. if the compiler fused the scalar
+	// multiply-adds, and for segments that only touch the window.
+	const float tolerance = 1e-5f;
+	size_t mismatches = 0;
+	for (size_t i = 0; i < count; i++) {
+		vec2 p0;
+		vec2 p1;
+		reference.get(i, p0, p1);
+		bool visible = clipSegment(rect, p0, p1);
+
+		vec2 q0;
+		vec2 q1;
+		batch.get(i, q0, q1);
+		bool batchVisible = batch.visible[i] != 0;
+
+		if (visible != batchVisible) {
+			vec2 a = visible ? p0 : q0;
+			vec2 b = visible ? p1 : q1;
+			if (length(b - a) > tolerance) {
+				mismatches++;
+			}
+		} else if (visible &&
+				(length(p0 - q0) > tolerance || length(p1 - q1) > tolerance)) {
+			mismatches++;
+		}
+	}
+	return mismatches;
+}
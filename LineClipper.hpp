@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Axis aligned clip window, in the same coordinates as the segments.
+struct ClipRect {
+	float lowX;
+	float highX;
+	float lowY;
+	float highY;
+};
+
+
+// 2D segments stored as structure-of-arrays for the batch clipper.
+class SegmentBatch {
+public:
+	void resize(size_t count);
+	void clear();
+	size_t size() const;
+
+	void set(size_t i, const glm::vec2 & p0, const glm::vec2 & p1);
+	void get(size_t i, glm::vec2 & p0, glm::vec2 & p1) const;
+
+	std::vector<float> x0;
+	std::vector<float> y0;
+	std::vector<float> x1;
+	std::vector<float> y1;
+
+	// Written by clipSegments: 1 if any part of the segment is inside.
+	std::vector<uint8_t> visible;
+};
+
+
+// Scalar Liang-Barsky reference.  Returns false if the segment lies entirely
+// outside "rect"; otherwise moves its endpoints onto the boundary as needed.
+// Endpoints that are already inside are left bit-for-bit unchanged.
+bool clipSegment(const ClipRect & rect, glm::vec2 & p0, glm::vec2 & p1);
+
+// Clips every segment of the batch in place, 4, 8 or 16 at a time depending
+// on the instruction set the file was built for.  The endpoints of segments
+// that are not visible are unspecified afterwards.
+void clipSegments(const ClipRect & rect, SegmentBatch & segments);
+
+// Runs clipSegments and clipSegment over "count" random segments, including
+// vertical, horizontal and degenerate ones, and returns the number of
+// segments on which they disagree.  A2_check (check/) runs it.
+size_t verifyLineClipper(size_t count, unsigned seed);
@@ -0,0 +1,69 @@
+#include "LogicThread.hpp"
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------
+// Constructor
+LogicThread::LogicThread()
+	: m_busy(false),
+	  m_stopping(false)
+{
+}
+
+//----------------------------------------------------------------------------------------
+// Destructor
+LogicThread::~LogicThread()
+{
+	if (!m_thread.joinable()) {
+		return;
+	}
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_one();
+	m_thread.join();
+}
+
+//----------------------------------------------------------------------------------------
+void LogicThread::start(const Job & job)
+{
+	wait();
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_job = job;
+		m_busy = true;
+	}
+	if (!m_thread.joinable()) {
+		m_thread = thread(&LogicThread::loop, this);
+	}
+	m_wake.notify_one();
+}
+
+//----------------------------------------------------------------------------------------
+void LogicThread::wait()
+{
+	unique_lock<mutex> lock(m_mutex);
+	m_done.wait(lock, [&]() { return !m_busy; });
+}
+
+//----------------------------------------------------------------------------------------
+void LogicThread::loop()
+{
+	unique_lock<mutex> lock(m_mutex);
+	while (true) {
+		m_wake.wait(lock, [&]() { return m_stopping || m_busy; });
+		if (!m_busy) {
+			return;
+		}
+
+		// The owner only touches m_job again after wait(), so it can run
+		// without the lock.
+		lock.unlock();
+		m_job();
+		lock.lock();
+
+		m_busy = false;
+		m_done.notify_all();
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// One thread that runs a job at a time for its owner, so the owner can get
+// on with other work until it needs the job's results.  The thread starts
+// with the first job and is joined on destruction.
+class LogicThread {
+public:
+	typedef std::function<void()> Job;
+
+	LogicThread();
+	~LogicThread();
+
+	// Hands "job" to the thread, once any job still running has finished.
+	void start(const Job & job);
+
+	// Blocks until the last job started has finished; returns at once when
+	// there is none.
+	void wait();
+
+private:
+	void loop();
+
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	Job m_job;
+	bool m_busy;
+	bool m_stopping;
+};
@@ -1,7 +1,102 @@
 #include "A2.hpp"
+#include "SceneFile.hpp"
 
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Usage:
+//   A2 [--instances N] [--budget MB] [--record <events>] [--capture <image|video.rgb>]
+//           [--on-demand] [mesh or scene file]
+//   A2 --headless <image.png|image.ppm> [--views N] [--size N] [--instances N] [--budget MB]
+//           [mesh or scene file]
+//   A2 --replay <events> [--headless <image>] [--step MS] [--size N] [--instances N]
+//           [--budget MB] [mesh or scene file]
+//   A2 --convert <scene file> [--chunk SIZE] <mesh files...>
 int main( int argc, char **argv ) 
 {
-	CS488Window::launch( argc, argv, new A2(), 768, 768, "Assignment 2" );
+	if (argc >= 3 && std::string(argv[1]) == "--convert") {
+		// --chunk splits each mesh into cubes of that size, for streaming.
+		float cellSize = 0.0f;
+		std::vector<std::string> meshFiles;
+		for (int i = 3; i < argc; i++) {
+			if (std::string(argv[i]) == "--chunk" && i + 1 < argc) {
+				cellSize = float(atof(argv[++i]));
+			} else {
+				meshFiles.push_back(argv[i]);
+			}
+		}
+		return SceneFile::convert(meshFiles, argv[2], cellSize) ? 0 : 1;
+	}
+
+	std::string meshFile;
+	std::string headlessImage;
+	std::string recordFile;
+	std::string captureFile;
+	std::string replayFile;
+	float stepMilliseconds = 1000.0f / 60.0f;
+	int views = 1;
+	int size = 768;
+	int instances = 0;
+	size_t budgetMegabytes = 0;
+	bool onDemand = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--headless" && i + 1 < argc) {
+			headlessImage = argv[++i];
+		} else if (arg == "--views" && i + 1 < argc) {
+			views = std::max(1, atoi(argv[++i]));
+		} else if (arg == "--size" && i + 1 < argc) {
+			// A 16384 pixel square image is already a gigabyte.
+			size = std::min(std::max(1, atoi(argv[++i])), 16384);
+		} else if (arg == "--instances" && i + 1 < argc) {
+			instances = std::max(0, atoi(argv[++i]));
+		} else if (arg == "--budget" && i + 1 < argc) {
+			budgetMegabytes = size_t(std::max(0, atoi(argv[++i])));
+		} else if (arg == "--record" && i + 1 < argc) {
+			recordFile = argv[++i];
+		} else if (arg == "--capture" && i + 1 < argc) {
+			// Numbered images, or raw RGBA frames for a .rgb file.
+			captureFile = argv[++i];
+		} else if (arg == "--replay" && i + 1 < argc) {
+			replayFile = argv[++i];
+		} else if (arg == "--step" && i + 1 < argc) {
+			stepMilliseconds = std::max(0.001f, float(atof(argv[++i])));
+		} else if (arg == "--on-demand") {
+			// Draw only when something changes, for windows left open idle.
+			onDemand = true;
+		} else {
+			// An OBJ or binary mesh file to draw instead of the cube.
+			meshFile = arg;
+		}
+	}
+
+	if (!replayFile.empty()) {
+		// The image, if any, is the last frame of the replay.
+		A2 app(meshFile);
+		app.setInstanceCount(instances);
+		app.setStreamBudget(budgetMegabytes << 20);
+		return app.replayInput(replayFile, headlessImage, size, size,
+				stepMilliseconds / 1000.0f) ? 0 : 1;
+	}
+
+	if (!headlessImage.empty()) {
+		A2 app(meshFile);
+		app.setInstanceCount(instances);
+		app.setStreamBudget(budgetMegabytes << 20);
+		return app.renderHeadless(headlessImage, size, size, views) ? 0 : 1;
+	}
+
+	A2 * app = new A2(meshFile);
+	app->setInstanceCount(instances);
+	app->setStreamBudget(budgetMegabytes << 20);
+	app->setOnDemand(onDemand);
+	app->captureFrames(captureFile);
+	if (!recordFile.empty() && !app->recordInput(recordFile)) {
+		return 1;
+	}
+	CS488Window::launch( argc, argv, app, 768, 768, "Assignment 2" );
 	return 0;
 }
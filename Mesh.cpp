@@ -0,0 +1,409 @@
+#include "Mesh.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+using namespace std;
+
+using namespace glm;
+
+namespace {
+
+const char kMeshMagic[4] = {'W', 'M', 'S', 'H'};
+const uint32_t kMeshVersion = 1;
+
+struct MeshFileHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t vertexCount;
+	uint32_t edgeCount;
+	uint32_t indexSize;
+	uint32_t reserved;
+};
+
+uint64_t edgeKey(uint32_t a, uint32_t b)
+{
+	if (a > b) {
+		swap(a, b);
+	}
+	return (uint64_t(a) << 32) | b;
+}
+
+// Converts a 1-based (or negative, relative) OBJ index to a 0-based one.
+// Anything after the first '/' (texture and normal indices) is ignored.
+bool parseObjIndex(const string & token, size_t vertexCount, uint32_t & index)
+{
+	long value = strtol(token.c_str(), nullptr, 10);
+	if (value < 0) {
+		value += long(vertexCount);
+	} else {
+		value -= 1;
+	}
+	if (value < 0 || size_t(value) >= vertexCount) {
+		return false;
+	}
+	index = uint32_t(value);
+	return true;
+}
+
+bool hasSuffix(const string & s, const string & suffix)
+{
+	return s.size() >= suffix.size() &&
+		s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}
+
+//----------------------------------------------------------------------------------------
+// Constructor
+Mesh::Mesh()
+{
+
+}
+
+//----------------------------------------------------------------------------------------
+Mesh Mesh::cube()
+{
+	Mesh mesh;
+	mesh.addVertex(vec3(1.0f, 1.0f, 1.0f));    // 0
+	mesh.addVertex(vec3(-1.0f, 1.0f, 1.0f));   // 1
+	mesh.addVertex(vec3(-1.0f, -1.0f, 1.0f));  // 2
+	mesh.addVertex(vec3(1.0f, -1.0f, 1.0f));   // 3
+	mesh.addVertex(vec3(1.0f, 1.0f, -1.0f));   // 4
+	mesh.addVertex(vec3(-1.0f, 1.0f, -1.0f));  // 5
+	mesh.addVertex(vec3(-1.0f, -1.0f, -1.0f)); // 6
+	mesh.addVertex(vec3(1.0f, -1.0f, -1.0f));  // 7
+
+	// Front face, the four edges joining front and back, then the back face.
+	mesh.addEdge(0, 1);
+	mesh.addEdge(1, 2);
+	mesh.addEdge(2, 3);
+	mesh.addEdge(3, 0);
+	mesh.addEdge(0, 4);
+	mesh.addEdge(1, 5);
+	mesh.addEdge(2, 6);
+	mesh.addEdge(3, 7);
+	mesh.addEdge(4, 5);
+	mesh.addEdge(5, 6);
+	mesh.addEdge(6, 7);
+	mesh.addEdge(7, 4);
+
+	// +z, -z, +x, -x, +y, -y.
+	const uint32_t corners[] = {
+		0, 1, 2, 3,
+		4, 7, 6, 5,
+		0, 3, 7, 4,
+		1, 5, 6, 2,
+		0, 4, 5, 1,
+		3, 2, 6, 7
+	};
+	mesh.linkFaces(vector<uint32_t>(corners, corners + 24), vector<uint32_t>(6, 4));
+	return mesh;
+}
+
+//----------------------------------------------------------------------------------------
+void Mesh::clear()
+{
+	vertices.clear();
+	edges.clear();
+	facePlanes.clear();
+	edgeFaces.clear();
+}
+
+//----------------------------------------------------------------------------------------
+uint32_t Mesh::addVertex(const vec3 & position)
+{
+	vertices.push_back(vec4(position, 1.0f));
+	return uint32_t(vertices.size() - 1);
+}
+
+//----------------------------------------------------------------------------------------
+void Mesh::addEdge(uint32_t a, uint32_t b)
+{
+	Edge edge = {a, b};
+	edges.push_back(edge);
+}
+
+//----------------------------------------------------------------------------------------
+void Mesh::linkFaces(const vector<uint32_t> & corners, const vector<uint32_t> & sizes)
+{
+	const uint32_t kNoFace = UINT32_MAX;
+	unordered_map<uint64_t, uint32_t> edgeIndices;
+	for (size_t i = 0; i < edges.size(); i++) {
+		edgeIndices[edgeKey(edges[i].a, edges[i].b)] = uint32_t(i);
+	}
+	EdgeFaces unlinked = {kNoFace, kNoFace};
+	facePlanes.clear();
+	edgeFaces.assign(edges.size(), unlinked);
+
+	bool closed = !edges.empty();
+	size_t first = 0;
+	for (size_t face = 0; face < sizes.size() && closed; face++) {
+		// Newell's normal, which holds up for polygons that are not quite flat.
+		size_t count = sizes[face];
+		vec3 normal(0.0f);
+		vec3 centre(0.0f);
+		for (size_t i = 0; i < count; i++) {
+			uint32_t a = corners[first + i];
+			uint32_t b = corners[first + (i + 1) % count];
+			vec3 p(vertices.x[a], vertices.y[a], vertices.z[a]);
+			vec3 q(vertices.x[b], vertices.y[b], vertices.z[b]);
+			normal += vec3((p[1] - q[1]) * (p[2] + q[2]), (p[2] - q[2]) * (p[0] + q[0]),
+					(p[0] - q[0]) * (p[1] + q[1]));
+			centre += p;
+			if (a == b) {
+				continue;
+			}
+			auto found = edgeIndices.find(edgeKey(a, b));
+			if (found == edgeIndices.end()) {
+				closed = false;
+				continue;
+			}
+			EdgeFaces & faces = edgeFaces[found->second];
+			uint32_t & slot = (faces.first == kNoFace) ? faces.first : faces.second;
+			closed = closed && slot == kNoFace;
+			slot = uint32_t(face);
+		}
+		centre = centre / float(max<size_t>(1, count));
+		facePlanes.push_back(vec4(normal, -dot(normal, centre)));
+		first += count;
+	}
+	for (const EdgeFaces & faces : edgeFaces) {
+		closed = closed && faces.second != kNoFace;
+	}
+
+	if (!closed) {
+		facePlanes.clear();
+		edgeFaces.clear();
+	}
+}
+
+//----------------------------------------------------------------------------------------
+void Mesh::bounds(vec3 & low, vec3 & high) const
+{
+	MeshView(*this).bounds(low, high);
+}
+
+//----------------------------------------------------------------------------------------
+// Constructor
+MeshView::MeshView()
+	: edges(nullptr),
+	  edgeCount(0),
+	  facePlanes(nullptr),
+	  faceCount(0),
+	  edgeFaces(nullptr)
+{
+}
+
+//----------------------------------------------------------------------------------------
+// Constructor
+MeshView::MeshView(const Mesh & mesh)
+	: vertices(mesh.vertices),
+	  edges(mesh.edges.data()),
+	  edgeCount(mesh.edges.size()),
+	  facePlanes(mesh.edgeFaces.empty() ? nullptr : mesh.facePlanes.data()),
+	  faceCount(mesh.edgeFaces.empty() ? 0 : mesh.facePlanes.size()),
+	  edgeFaces(mesh.edgeFaces.empty() ? nullptr : mesh.edgeFaces.data())
+{
+}
+
+//----------------------------------------------------------------------------------------
+void MeshView::bounds(vec3 & low, vec3 & high) const
+{
+	size_t count = vertices.count;
+	if (count == 0) {
+		low = vec3(0.0f);
+		high = vec3(0.0f);
+		return;
+	}
+	low = vec3(vertices.x[0], vertices.y[0], vertices.z[0]);
+	high = low;
+	for (size_t i = 1; i < count; i++) {
+		vec3 point(vertices.x[i], vertices.y[i], vertices.z[i]);
+		low = glm::min(low, point);
+		high = glm::max(high, point);
+	}
+}
+
+//----------------------------------------------------------------------------------------
+bool Mesh::loadObj(const string & path)
+{
+	ifstream in(path.c_str());
+	if (!in) {
+		cerr << "Mesh: could not open " << path << endl;
+		return false;
+	}
+
+	Mesh mesh;
+	unordered_set<uint64_t> seen;
+	vector<uint32_t> indices;
+	vector<uint32_t> faceCorners;
+	vector<uint32_t> faceSizes;
+	string line;
+	int lineNumber = 0;
+
+	while (getline(in, line)) {
+		lineNumber++;
+		istringstream tokens(line);
+		string type;
+		tokens >> type;
+
+		if (type == "v") {
+			vec3 p;
+			tokens >> p[0] >> p[1] >> p[2];
+			mesh.addVertex(p);
+		}
+		else if (type == "l" || type == "f") {
+			indices.clear();
+			string token;
+			while (tokens >> token) {
+				uint32_t index;
+				if (!parseObjIndex(token, mesh.vertices.size(), index)) {
+					cerr << "Mesh: bad index '" << token << "' at " << path << ":"
+						<< lineNumber << endl;
+					return false;
+				}
+				indices.push_back(index);
+			}
+
+			// A polyline joins consecutive indices; a face also closes the loop.
+			size_t count = indices.size();
+			size_t edgeCount = (type == "f" && count > 2) ? count : count - 1;
+			for (size_t i = 0; count > 1 && i < edgeCount; i++) {
+				uint32_t a = indices[i];
+				uint32_t b = indices[(i + 1) % count];
+				if (a != b && seen.insert(edgeKey(a, b)).second) {
+					mesh.addEdge(a, b);
+				}
+			}
+			if (type == "f" && count > 2) {
+				faceCorners.insert(faceCorners.end(), indices.begin(), indices.end());
+				faceSizes.push_back(uint32_t(count));
+			}
+		}
+	}
+	mesh.linkFaces(faceCorners, faceSizes);
+
+	*this = mesh;
+	return true;
+}
+
+//----------------------------------------------------------------------------------------
+bool Mesh::loadBinary(const string & path)
+{
+	ifstream in(path.c_str(), ios::binary);
+	if (!in) {
+		cerr << "Mesh: could not open " << path << endl;
+		return false;
+	}
+
+	MeshFileHeader header;
+	in.read(reinterpret_cast<char *>(&header), sizeof(header));
+	if (!in || memcmp(header.magic, kMeshMagic, sizeof(kMeshMagic)) != 0 ||
+			header.version != kMeshVersion ||
+			(header.indexSize != 2 && header.indexSize != 4)) {
+		cerr << "Mesh: " << path << " is not a version " << kMeshVersion
+			<< " mesh file" << endl;
+		return false;
+	}
+
+	// The header's counts are only believed once the file is long enough to
+	// hold them, so a corrupt header cannot ask for gigabytes.
+	size_t positionCount = size_t(header.vertexCount) * 3;
+	size_t indexCount = size_t(header.edgeCount) * 2;
+	uint64_t expected = sizeof(header) + uint64_t(positionCount) * sizeof(float) +
+		uint64_t(indexCount) * header.indexSize;
+	streamoff dataStart = in.tellg();
+	in.seekg(0, ios::end);
+	streamoff fileSize = in.tellg();
+	in.seekg(dataStart);
+	if (!in || dataStart < 0 || fileSize < 0 || uint64_t(fileSize) < expected) {
+		cerr << "Mesh: " << path << " is truncated" << endl;
+		return false;
+	}
+
+	vector<float> positions(positionCount);
+	in.read(reinterpret_cast<char *>(positions.data()), positions.size() * sizeof(float));
+	if (!in) {
+		cerr << "Mesh: " << path << " is truncated" << endl;
+		return false;
+	}
+
+	vector<uint32_t> indices(indexCount);
+	if (header.indexSize == 2) {
+		vector<uint16_t> shortIndices(indexCount);
+		in.read(reinterpret_cast<char *>(shortIndices.data()), indexCount * sizeof(uint16_t));
+		indices.assign(shortIndices.begin(), shortIndices.end());
+	} else {
+		in.read(reinterpret_cast<char *>(indices.data()), indexCount * sizeof(uint32_t));
+	}
+	if (!in) {
+		cerr << "Mesh: " << path << " is truncated" << endl;
+		return false;
+	}
+
+	Mesh mesh;
+	for (size_t i = 0; i < header.vertexCount; i++) {
+		mesh.addVertex(vec3(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]));
+	}
+
+	for (size_t i = 0; i < indexCount; i += 2) {
+		if (indices[i] >= header.vertexCount || indices[i + 1] >= header.vertexCount) {
+			cerr << "Mesh: " << path << " has an out of range edge index" << endl;
+			return false;
+		}
+		mesh.addEdge(indices[i], indices[i + 1]);
+	}
+
+	*this = mesh;
+	return true;
+}
+
+//----------------------------------------------------------------------------------------
+bool Mesh::saveBinary(const string & path) const
+{
+	ofstream out(path.c_str(), ios::binary);
+	if (!out) {
+		cerr << "Mesh: could not create " << path << endl;
+		return false;
+	}
+
+	MeshFileHeader header;
+	memcpy(header.magic, kMeshMagic, sizeof(kMeshMagic));
+	header.version = kMeshVersion;
+	header.vertexCount = uint32_t(vertices.size());
+	header.edgeCount = uint32_t(edges.size());
+	header.indexSize = (vertices.size() <= 0x10000) ? 2 : 4;
+	header.reserved = 0;
+	out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+	for (size_t i = 0; i < vertices.size(); i++) {
+		float p[3] = {vertices.x[i], vertices.y[i], vertices.z[i]};
+		out.write(reinterpret_cast<const char *>(p), sizeof(p));
+	}
+
+	for (const Edge & edge : edges) {
+		if (header.indexSize == 2) {
+			uint16_t pair[2] = {uint16_t(edge.a), uint16_t(edge.b)};
+			out.write(reinterpret_cast<const char *>(pair), sizeof(pair));
+		} else {
+			out.write(reinterpret_cast<const char *>(&edge), sizeof(edge));
+		}
+	}
+
+	return bool(out);
+}
+
+//----------------------------------------------------------------------------------------
+bool Mesh::load(const string & path)
+{
+	if (hasSuffix(path, ".obj") || hasSuffix(path, ".OBJ")) {
+		return loadObj(path);
+	}
+	return loadBinary(path);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "VertexTransform.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A line between two entries of Mesh::vertices.
+struct Edge {
+	uint32_t a;
+	uint32_t b;
+};
+
+// The two faces either side of an edge of a closed mesh, as indices into
+// Mesh::facePlanes.
+struct EdgeFaces {
+	uint32_t first;
+	uint32_t second;
+};
+
+
+// Indexed wireframe mesh: each corner is stored once, and edges refer to
+// corners by index, so per-vertex work is never repeated for shared corners.
+class Mesh {
+public:
+	Mesh();
+
+	static Mesh cube();
+
+	void clear();
+	uint32_t addVertex(const glm::vec3 & position);
+	void addEdge(uint32_t a, uint32_t b);
+
+	// Axis aligned bounding box of the vertices; both zero if there are none.
+	void bounds(glm::vec3 & low, glm::vec3 & high) const;
+
+	// Reads "v" records, and takes edges from "l" polylines and "f" polygon
+	// outlines.  Edges shared by several faces are only kept once.  Faces,
+	// counterclockwise seen from outside, also give the face adjacency when
+	// they close the mesh.
+	bool loadObj(const std::string & path);
+
+	// Compact binary form: a small header, float xyz per vertex, then 16 or
+	// 32-bit index pairs depending on the vertex count.  Face adjacency is not
+	// stored, so a loaded mesh cannot hide its back edges.
+	bool loadBinary(const std::string & path);
+	bool saveBinary(const std::string & path) const;
+
+	// Picks loadObj or loadBinary from the file extension.
+	bool load(const std::string & path);
+
+	// Sets facePlanes and edgeFaces from polygons given as runs of corner
+	// indices, "sizes" long.  Both are left empty unless every edge borders
+	// exactly two of the faces, as only a closed mesh hides its back edges.
+	void linkFaces(const std::vector<uint32_t> & corners, const std::vector<uint32_t> & sizes);
+
+	PointBatch vertices;
+	std::vector<Edge> edges;
+
+	// Closed meshes only.  A plane is the outward normal, then minus its dot
+	// product with a corner, so it is positive at points in front of the
+	// face.  edgeFaces runs parallel to edges.
+	std::vector<glm::vec4> facePlanes;
+	std::vector<EdgeFaces> edgeFaces;
+};
+
+
+// Read-only view of a mesh's vertices and edges, either a Mesh's or memory
+// no Mesh owns, such as an object in a mapped scene file.  Only valid while
+// the memory it points into is.
+struct MeshView {
+	MeshView();
+	MeshView(const Mesh & mesh);
+
+	void bounds(glm::vec3 & low, glm::vec3 & high) const;
+
+	PointArrays vertices;
+	const Edge * edges;
+	size_t edgeCount;
+
+	// Face adjacency, or null and 0 for meshes without it.
+	const glm::vec4 * facePlanes;
+	size_t faceCount;
+	const EdgeFaces * edgeFaces;
+};
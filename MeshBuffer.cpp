@@ -0,0 +1,157 @@
+#include "MeshBuffer.hpp"
+#include "cs488-framework/GlErrorCheck.hpp"
+
+#include <vector>
+using namespace std;
+
+//----------------------------------------------------------------------------------------
+// Constructor
+MeshBuffer::MeshBuffer()
+	: m_vao(0),
+	  m_positions(0),
+	  m_indices(0),
+	  m_indexCount(0),
+	  m_instances(0),
+	  m_instanceCount(0)
+{
+}
+
+//----------------------------------------------------------------------------------------
+// Destructor
+MeshBuffer::~MeshBuffer()
+{
+	// GL objects are released in destroy(), while the context still exists.
+}
+
+//----------------------------------------------------------------------------------------
+void MeshBuffer::upload(const MeshView & mesh, GLint positionLocation)
+{
+	destroy();
+
+	// The mesh keeps its points as w = 1 structure-of-arrays; the shader
+	// only needs interleaved xyz.
+	size_t vertexCount = mesh.vertices.count;
+	vector<float> positions(3 * vertexCount);
+	for (size_t i = 0; i < vertexCount; i++) {
+		positions[3 * i] = mesh.vertices.x[i];
+		positions[3 * i + 1] = mesh.vertices.y[i];
+		positions[3 * i + 2] = mesh.vertices.z[i];
+	}
+
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+
+	glGenBuffers(1, &m_positions);
+	glBindBuffer(GL_ARRAY_BUFFER, m_positions);
+	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(float), positions.data(),
+			GL_STATIC_DRAW);
+	glEnableVertexAttribArray(positionLocation);
+	glVertexAttribPointer(positionLocation, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+	// Edge is two packed uint32_t, so the edge array is already an index list.
+	glGenBuffers(1, &m_indices);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indices);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.edgeCount * sizeof(Edge), mesh.edges,
+			GL_STATIC_DRAW);
+	m_indexCount = GLsizei(2 * mesh.edgeCount);
+
+	// The element buffer binding is VAO state, so unbind the VAO first.
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	CHECK_GL_ERRORS;
+}
+
+//----------------------------------------------------------------------------------------
+void MeshBuffer::destroy()
+{
+	if (m_vao) {
+		glDeleteVertexArrays(1, &m_vao);
+		glDeleteBuffers(1, &m_positions);
+		glDeleteBuffers(1, &m_indices);
+		m_vao = 0;
+		m_positions = 0;
+		m_indices = 0;
+	}
+	if (m_instances) {
+		glDeleteBuffers(1, &m_instances);
+		m_instances = 0;
+	}
+	m_indexCount = 0;
+	m_instanceCount = 0;
+}
+
+//----------------------------------------------------------------------------------------
+void MeshBuffer::draw() const
+{
+	if (m_indexCount == 0) {
+		return;
+	}
+	glBindVertexArray(m_vao);
+	glDrawElements(GL_LINES, m_indexCount, GL_UNSIGNED_INT, nullptr);
+	glBindVertexArray(0);
+}
+
+//----------------------------------------------------------------------------------------
+void MeshBuffer::drawEdges(size_t firstEdge, size_t edgeCount, GLint baseVertex) const
+{
+	if (edgeCount == 0) {
+		return;
+	}
+	glBindVertexArray(m_vao);
+	glDrawElementsBaseVertex(GL_LINES, GLsizei(2 * edgeCount), GL_UNSIGNED_INT,
+			reinterpret_cast<void *>(firstEdge * sizeof(Edge)), baseVertex);
+	glBindVertexArray(0);
+}
+
+//----------------------------------------------------------------------------------------
+void MeshBuffer::setInstanceAttribute(GLint modelLocation)
+{
+	if (m_instances == 0) {
+		glGenBuffers(1, &m_instances);
+	}
+
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_instances);
+
+	// A mat3x4 attribute is three vec4 columns, each advancing per
+	// instance; 48 bytes per instance rather than a mat4's 64.
+	for (GLint column = 0; column < 3; column++) {
+		GLint location = modelLocation + column;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(Affine),
+				reinterpret_cast<void *>(sizeof(Affine::rows[0]) * column));
+		glVertexAttribDivisor(location, 1);
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	CHECK_GL_ERRORS;
+}
+
+//----------------------------------------------------------------------------------------
+void MeshBuffer::uploadInstances(const vector<Affine> & transforms)
+{
+	m_instanceCount = GLsizei(transforms.size());
+
+	// Orphan the old storage, so a draw still reading it never stalls us.
+	glBindBuffer(GL_ARRAY_BUFFER, m_instances);
+	glBufferData(GL_ARRAY_BUFFER, transforms.size() * sizeof(Affine), transforms.data(),
+			GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	CHECK_GL_ERRORS;
+}
+
+//----------------------------------------------------------------------------------------
+void MeshBuffer::drawInstanced() const
+{
+	if (m_indexCount == 0 || m_instanceCount == 0) {
+		return;
+	}
+	glBindVertexArray(m_vao);
+	glDrawElementsInstanced(GL_LINES, m_indexCount, GL_UNSIGNED_INT, nullptr, m_instanceCount);
+	glBindVertexArray(0);
+}
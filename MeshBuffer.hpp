@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Affine.hpp"
+#include "Mesh.hpp"
+
+#include "cs488-framework/OpenGLImport.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Static GPU copy of a mesh: xyz positions and edge indices, uploaded once
+// and drawn as GL_LINES, with the transform left to the vertex shader and
+// clipping to the hardware.
+class MeshBuffer {
+public:
+	MeshBuffer();
+	~MeshBuffer();
+
+	// Replaces any previous upload.  "positionLocation" is the vertex
+	// attribute the shader reads the 3D position from.
+	void upload(const MeshView & mesh, GLint positionLocation);
+	void destroy();
+
+	// Draws every edge with whatever program is bound.
+	void draw() const;
+
+	// Draws edges [firstEdge, firstEdge + edgeCount), adding baseVertex to
+	// their indices; for meshes that pack several objects with object
+	// relative indices, like a scene file.
+	void drawEdges(size_t firstEdge, size_t edgeCount, GLint baseVertex) const;
+
+	// Per-instance model transforms for drawInstanced, read through a mat3x4
+	// attribute holding an Affine's rows as its columns, which spans
+	// locations modelLocation to modelLocation + 2.  Call after upload.
+	void setInstanceAttribute(GLint modelLocation);
+
+	// Replaces the instance buffer with "transforms", one per instance to draw.
+	void uploadInstances(const std::vector<Affine> & transforms);
+
+	// Draws every edge once per uploaded instance.
+	void drawInstanced() const;
+
+private:
+	GLuint m_vao;
+	GLuint m_positions;
+	GLuint m_indices;
+	GLsizei m_indexCount;
+
+	GLuint m_instances;
+	GLsizei m_instanceCount;
+};
@@ -0,0 +1,477 @@
+#include "SceneFile.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+using namespace std;
+
+using namespace glm;
+
+namespace {
+
+const char kSceneMagic[4] = {'W', 'S', 'C', 'N'};
+const uint32_t kSceneVersion = 2;
+
+// States of SceneFile::m_edgeChecks.
+const uint8_t kEdgesUnchecked = 0;
+const uint8_t kEdgesValid = 1;
+const uint8_t kEdgesInvalid = 2;
+
+// Section alignment: a cache line, and a multiple of any SIMD load width.
+const uint64_t kSceneAlignment = 64;
+
+uint64_t alignUp(uint64_t offset)
+{
+	return (offset + kSceneAlignment - 1) & ~(kSceneAlignment - 1);
+}
+
+// True if "count" elements of "elementSize" bytes at "offset" fit in a file
+// of "size" bytes, without overflowing on hostile counts.
+bool sectionFits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t size)
+{
+	return offset % kSceneAlignment == 0 && offset <= size &&
+		count <= (size - offset) / elementSize;
+}
+
+// Drops the pages lying wholly inside [begin, begin + bytes) from a read-only
+// file mapping; touching them again reads them back from the file.
+void releasePages(const void * begin, size_t bytes)
+{
+	uintptr_t page = uintptr_t(sysconf(_SC_PAGESIZE));
+	uintptr_t first = (uintptr_t(begin) + page - 1) & ~(page - 1);
+	uintptr_t last = (uintptr_t(begin) + bytes) & ~(page - 1);
+	if (first < last) {
+		madvise(reinterpret_cast<void *>(first), last - first, MADV_DONTNEED);
+	}
+}
+
+// Grid cell of a point, packed into one key; 21 bits per axis is more
+// cells than any scene here needs.
+uint64_t cellKey(const vec3 & point, float cellSize)
+{
+	uint64_t key = 0;
+	for (int axis = 0; axis < 3; axis++) {
+		int64_t cell = int64_t(std::floor(point[axis] / cellSize)) + (1 << 20);
+		key = (key << 21) | (uint64_t(cell) & ((1 << 21) - 1));
+	}
+	return key;
+}
+
+// Appends one object per cubic cell of "cellSize" that holds the midpoint
+// of any of the mesh's edges.  Vertices shared across cells are copied
+// into each cell's object, so each object stands alone.
+void splitIntoCells(const Mesh & mesh, float cellSize, vector<SceneObject> & objects)
+{
+	size_t firstObject = objects.size();
+	unordered_map<uint64_t, size_t> cellObjects;
+	vector<unordered_map<uint32_t, uint32_t>> remaps;
+
+	const PointBatch & points = mesh.vertices;
+	for (const Edge & edge : mesh.edges) {
+		vec3 a(points.x[edge.a], points.y[edge.a], points.z[edge.a]);
+		vec3 b(points.x[edge.b], points.y[edge.b], points.z[edge.b]);
+		uint64_t key = cellKey(0.5f * (a + b), cellSize);
+
+		auto found = cellObjects.find(key);
+		if (found == cellObjects.end()) {
+			found = cellObjects.insert(make_pair(key, objects.size())).first;
+			SceneObject object;
+			object.transform = mat4(1.0f);
+			object.colour = vec3(0.0f);
+			objects.push_back(object);
+			remaps.push_back(unordered_map<uint32_t, uint32_t>());
+		}
+		Mesh & cell = objects[found->second].mesh;
+		unordered_map<uint32_t, uint32_t> & remap = remaps[found->second - firstObject];
+
+		uint32_t ends[2] = {edge.a, edge.b};
+		for (uint32_t & end : ends) {
+			auto mapped = remap.find(end);
+			if (mapped == remap.end()) {
+				vec3 p(points.x[end], points.y[end], points.z[end]);
+				mapped = remap.insert(make_pair(end, cell.addVertex(p))).first;
+			}
+			end = mapped->second;
+		}
+		cell.addEdge(ends[0], ends[1]);
+	}
+}
+
+}
+
+// Little endian, as written by write() on the machines we build for.
+struct SceneFile::Header {
+	char magic[4];
+	uint32_t version;
+	uint32_t objectCount;
+	uint32_t reserved;
+	uint64_t vertexCount;
+	uint64_t edgeCount;
+	uint64_t fileSize;
+	uint64_t objectsOffset;
+	uint64_t xOffset;
+	uint64_t yOffset;
+	uint64_t zOffset;
+	uint64_t wOffset;
+	uint64_t edgesOffset;
+};
+
+struct SceneFile::ObjectRecord {
+	float transform[16];  // Column major, as glm stores it.
+	float colour[4];      // rgb, then unused.
+	float low[4];         // Bounds of the vertices, before the transform;
+	float high[4];        // xyz, then unused.
+	uint64_t firstVertex;
+	uint64_t vertexCount;
+	uint64_t firstEdge;
+	uint64_t edgeCount;
+};
+
+//----------------------------------------------------------------------------------------
+// Constructor
+SceneFile::SceneFile()
+	: m_data(nullptr),
+	  m_size(0),
+	  m_header(nullptr),
+	  m_objects(nullptr),
+	  m_edges(nullptr)
+{
+}
+
+//----------------------------------------------------------------------------------------
+// Destructor
+SceneFile::~SceneFile()
+{
+	close();
+}
+
+//----------------------------------------------------------------------------------------
+bool SceneFile::open(const string & path)
+{
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		cerr << "SceneFile: could not open " << path << endl;
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(Header)) {
+		cerr << "SceneFile: " << path << " is not a scene file" << endl;
+		::close(fd);
+		return false;
+	}
+
+	// A shared read-only mapping: pages come from the page cache on first
+	// touch and are never copied, so other processes reuse them.
+	size_t size = size_t(info.st_size);
+	void * data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED) {
+		cerr << "SceneFile: could not map " << path << endl;
+		return false;
+	}
+	m_data = static_cast<const unsigned char *>(data);
+	m_size = size;
+
+	const Header * header = reinterpret_cast<const Header *>(m_data);
+	if (memcmp(header->magic, kSceneMagic, sizeof(kSceneMagic)) != 0 ||
+			header->version != kSceneVersion) {
+		cerr << "SceneFile: " << path << " is not a version " << kSceneVersion
+			<< " scene file" << endl;
+		close();
+		return false;
+	}
+	if (header->fileSize != size ||
+			!sectionFits(header->objectsOffset, header->objectCount, sizeof(ObjectRecord), size) ||
+			!sectionFits(header->xOffset, header->vertexCount, sizeof(float), size) ||
+			!sectionFits(header->yOffset, header->vertexCount, sizeof(float), size) ||
+			!sectionFits(header->zOffset, header->vertexCount, sizeof(float), size) ||
+			!sectionFits(header->wOffset, header->vertexCount, sizeof(float), size) ||
+			!sectionFits(header->edgesOffset, header->edgeCount, sizeof(Edge), size)) {
+		cerr << "SceneFile: " << path << " is truncated or corrupt" << endl;
+		close();
+		return false;
+	}
+
+	const ObjectRecord * objects =
+			reinterpret_cast<const ObjectRecord *>(m_data + header->objectsOffset);
+	for (uint32_t i = 0; i < header->objectCount; i++) {
+		const ObjectRecord & object = objects[i];
+		if (object.firstVertex > header->vertexCount ||
+				object.vertexCount > header->vertexCount - object.firstVertex ||
+				object.firstEdge > header->edgeCount ||
+				object.edgeCount > header->edgeCount - object.firstEdge) {
+			cerr << "SceneFile: " << path << " has an object out of range" << endl;
+			close();
+			return false;
+		}
+	}
+
+	m_header = header;
+	m_objects = objects;
+	m_vertices.x = reinterpret_cast<const float *>(m_data + header->xOffset);
+	m_vertices.y = reinterpret_cast<const float *>(m_data + header->yOffset);
+	m_vertices.z = reinterpret_cast<const float *>(m_data + header->zOffset);
+	m_vertices.w = reinterpret_cast<const float *>(m_data + header->wOffset);
+	m_vertices.count = size_t(header->vertexCount);
+	m_edges = reinterpret_cast<const Edge *>(m_data + header->edgesOffset);
+	m_path = path;
+	m_edgeChecks.reset(new atomic<uint8_t>[header->objectCount]);
+	for (uint32_t i = 0; i < header->objectCount; i++) {
+		m_edgeChecks[i] = kEdgesUnchecked;
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------------------
+void SceneFile::close()
+{
+	if (m_data) {
+		munmap(const_cast<unsigned char *>(m_data), m_size);
+	}
+	m_data = nullptr;
+	m_size = 0;
+	m_header = nullptr;
+	m_objects = nullptr;
+	m_vertices = PointArrays();
+	m_edges = nullptr;
+	m_path.clear();
+	m_edgeChecks.reset();
+}
+
+//----------------------------------------------------------------------------------------
+bool SceneFile::isOpen() const
+{
+	return m_header != nullptr;
+}
+
+//----------------------------------------------------------------------------------------
+size_t SceneFile::objectCount() const
+{
+	return m_header ? m_header->objectCount : 0;
+}
+
+//----------------------------------------------------------------------------------------
+const SceneFile::ObjectRecord & SceneFile::record(size_t object) const
+{
+	return m_objects[object];
+}
+
+//----------------------------------------------------------------------------------------
+MeshView SceneFile::mesh(size_t object) const
+{
+	const ObjectRecord & r = record(object);
+	MeshView view;
+	view.vertices.x = m_vertices.x + r.firstVertex;
+	view.vertices.y = m_vertices.y + r.firstVertex;
+	view.vertices.z = m_vertices.z + r.firstVertex;
+	view.vertices.w = m_vertices.w + r.firstVertex;
+	view.vertices.count = size_t(r.vertexCount);
+	view.edges = m_edges + r.firstEdge;
+	view.edgeCount = size_t(r.edgeCount);
+	return view;
+}
+
+//----------------------------------------------------------------------------------------
+bool SceneFile::edgesValid(size_t object) const
+{
+	uint8_t state = m_edgeChecks[object].load(memory_order_acquire);
+	if (state != kEdgesUnchecked) {
+		return state == kEdgesValid;
+	}
+
+	const ObjectRecord & r = record(object);
+	const Edge * edges = m_edges + r.firstEdge;
+	bool valid = true;
+	for (uint64_t i = 0; i < r.edgeCount && valid; i++) {
+		valid = edges[i].a < r.vertexCount && edges[i].b < r.vertexCount;
+	}
+
+	// Two threads may both check an object; only the first reports it.
+	uint8_t expected = kEdgesUnchecked;
+	if (m_edgeChecks[object].compare_exchange_strong(expected,
+			valid ? kEdgesValid : kEdgesInvalid) && !valid) {
+		cerr << "SceneFile: object " << object << " of " << m_path
+			<< " has edges outside its vertices; skipping it" << endl;
+	}
+	return valid;
+}
+
+//----------------------------------------------------------------------------------------
+mat4 SceneFile::transform(size_t object) const
+{
+	mat4 m;
+	memcpy(&m[0][0], record(object).transform, sizeof(m));
+	return m;
+}
+
+//----------------------------------------------------------------------------------------
+vec3 SceneFile::colour(size_t object) const
+{
+	const float * c = record(object).colour;
+	return vec3(c[0], c[1], c[2]);
+}
+
+//----------------------------------------------------------------------------------------
+void SceneFile::bounds(size_t object, vec3 & low, vec3 & high) const
+{
+	const ObjectRecord & r = record(object);
+	low = vec3(r.low[0], r.low[1], r.low[2]);
+	high = vec3(r.high[0], r.high[1], r.high[2]);
+}
+
+//----------------------------------------------------------------------------------------
+void SceneFile::release(size_t object) const
+{
+	const ObjectRecord & r = record(object);
+	size_t vertexBytes = size_t(r.vertexCount) * sizeof(float);
+	releasePages(m_vertices.x + r.firstVertex, vertexBytes);
+	releasePages(m_vertices.y + r.firstVertex, vertexBytes);
+	releasePages(m_vertices.z + r.firstVertex, vertexBytes);
+	releasePages(m_vertices.w + r.firstVertex, vertexBytes);
+	releasePages(m_edges + r.firstEdge, size_t(r.edgeCount) * sizeof(Edge));
+}
+
+//----------------------------------------------------------------------------------------
+size_t SceneFile::firstVertex(size_t object) const
+{
+	return size_t(record(object).firstVertex);
+}
+
+//----------------------------------------------------------------------------------------
+size_t SceneFile::firstEdge(size_t object) const
+{
+	return size_t(record(object).firstEdge);
+}
+
+//----------------------------------------------------------------------------------------
+MeshView SceneFile::allObjects() const
+{
+	MeshView view;
+	if (m_header) {
+		view.vertices = m_vertices;
+		view.edges = m_edges;
+		view.edgeCount = size_t(m_header->edgeCount);
+	}
+	return view;
+}
+
+//----------------------------------------------------------------------------------------
+bool SceneFile::write(const string & path, const vector<SceneObject> & objects)
+{
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kSceneMagic, sizeof(kSceneMagic));
+	header.version = kSceneVersion;
+	header.objectCount = uint32_t(objects.size());
+
+	vector<ObjectRecord> records(objects.size());
+	for (size_t i = 0; i < objects.size(); i++) {
+		const SceneObject & object = objects[i];
+		ObjectRecord & r = records[i];
+		memcpy(r.transform, &object.transform[0][0], sizeof(r.transform));
+		r.colour[0] = object.colour[0];
+		r.colour[1] = object.colour[1];
+		r.colour[2] = object.colour[2];
+		r.colour[3] = 0.0f;
+		vec3 low;
+		vec3 high;
+		object.mesh.bounds(low, high);
+		for (int axis = 0; axis < 3; axis++) {
+			r.low[axis] = low[axis];
+			r.high[axis] = high[axis];
+		}
+		r.low[3] = 0.0f;
+		r.high[3] = 0.0f;
+		r.firstVertex = header.vertexCount;
+		r.vertexCount = object.mesh.vertices.size();
+		r.firstEdge = header.edgeCount;
+		r.edgeCount = object.mesh.edges.size();
+		header.vertexCount += r.vertexCount;
+		header.edgeCount += r.edgeCount;
+	}
+
+	header.objectsOffset = alignUp(sizeof(Header));
+	header.xOffset = alignUp(header.objectsOffset + records.size() * sizeof(ObjectRecord));
+	header.yOffset = alignUp(header.xOffset + header.vertexCount * sizeof(float));
+	header.zOffset = alignUp(header.yOffset + header.vertexCount * sizeof(float));
+	header.wOffset = alignUp(header.zOffset + header.vertexCount * sizeof(float));
+	header.edgesOffset = alignUp(header.wOffset + header.vertexCount * sizeof(float));
+	header.fileSize = header.edgesOffset + header.edgeCount * sizeof(Edge);
+
+	ofstream out(path.c_str(), ios::binary);
+	if (!out) {
+		cerr << "SceneFile: could not create " << path << endl;
+		return false;
+	}
+
+	// Sections are written in file order, zero padded up to each offset.
+	uint64_t position = 0;
+	auto writeAt = [&](uint64_t offset, const void * data, size_t bytes) {
+		static const char zeros[kSceneAlignment] = {};
+		out.write(zeros, streamsize(offset - position));
+		out.write(static_cast<const char *>(data), streamsize(bytes));
+		position = offset + bytes;
+	};
+	writeAt(0, &header, sizeof(header));
+	writeAt(header.objectsOffset, records.data(), records.size() * sizeof(ObjectRecord));
+
+	uint64_t offsets[4] = {header.xOffset, header.yOffset, header.zOffset, header.wOffset};
+	for (int axis = 0; axis < 4; axis++) {
+		writeAt(offsets[axis], nullptr, 0);
+		for (const SceneObject & object : objects) {
+			const PointBatch & points = object.mesh.vertices;
+			const vector<float> & values = axis == 0 ? points.x : axis == 1 ? points.y :
+					axis == 2 ? points.z : points.w;
+			out.write(reinterpret_cast<const char *>(values.data()),
+					streamsize(values.size() * sizeof(float)));
+			position += values.size() * sizeof(float);
+		}
+	}
+
+	writeAt(header.edgesOffset, nullptr, 0);
+	for (const SceneObject & object : objects) {
+		out.write(reinterpret_cast<const char *>(object.mesh.edges.data()),
+				streamsize(object.mesh.edges.size() * sizeof(Edge)));
+	}
+
+	return bool(out);
+}
+
+//----------------------------------------------------------------------------------------
+bool SceneFile::convert(const vector<string> & meshFiles, const string & path,
+		float cellSize)
+{
+	vector<SceneObject> objects;
+	for (const string & meshFile : meshFiles) {
+		SceneObject object;
+		if (!object.mesh.load(meshFile)) {
+			return false;
+		}
+		if (cellSize > 0.0f) {
+			splitIntoCells(object.mesh, cellSize, objects);
+			continue;
+		}
+		object.transform = mat4(1.0f);
+		object.colour = vec3(0.0f);
+		objects.push_back(object);
+	}
+	return write(path, objects);
+}
+
+//----------------------------------------------------------------------------------------
+bool SceneFile::isSceneFile(const string & path)
+{
+	ifstream in(path.c_str(), ios::binary);
+	char magic[4];
+	in.read(magic, sizeof(magic));
+	return in && memcmp(magic, kSceneMagic, sizeof(kSceneMagic)) == 0;
+}
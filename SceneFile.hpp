@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Mesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// One object of a scene: a mesh, placed by "transform" and drawn in "colour".
+struct SceneObject {
+	Mesh mesh;
+	glm::mat4 transform;
+	glm::vec3 colour;
+};
+
+
+// Read-only binary scene, memory mapped and used in place.
+//
+// The file is a header, an object table, then the x, y, z and w vertex
+// arrays and the edge array of all objects back to back, each section
+// starting on a kSceneAlignment boundary.  An object's edges index its own
+// vertices, so an object's MeshView points straight into the mapping and
+// nothing is parsed or copied on open: pages are read on first touch, and
+// processes mapping the same file share them through the page cache.
+//
+// open() checks the header and the object table.  Edge indices are checked
+// per object by edgesValid(), the first time the object is used, since
+// checking them all on open would touch every page of the file.  write()
+// produces files open() accepts.
+class SceneFile {
+public:
+	SceneFile();
+	~SceneFile();
+
+	bool open(const std::string & path);
+	void close();
+	bool isOpen() const;
+
+	size_t objectCount() const;
+	MeshView mesh(size_t object) const;
+	glm::mat4 transform(size_t object) const;
+	glm::vec3 colour(size_t object) const;
+
+	// Bounding box of an object's vertices, before its transform.  Stored in
+	// the object table, so it costs no vertex reads.
+	void bounds(size_t object, glm::vec3 & low, glm::vec3 & high) const;
+
+	// Lets the kernel drop the object's pages from this process, for when a
+	// copy of it is kept elsewhere; the view stays valid, at the cost of
+	// page faults if it is read again.
+	void release(size_t object) const;
+
+	// True if every edge of the object indexes one of its own vertices.  The
+	// first call for an object reads its edges and reports a bad object;
+	// later calls return the remembered answer.  Safe from any thread.
+	bool edgesValid(size_t object) const;
+
+	// The first vertex and edge of an object among all of the file's.
+	size_t firstVertex(size_t object) const;
+	size_t firstEdge(size_t object) const;
+
+	// Every object's vertices and edges as one mesh, with object relative
+	// indices; see MeshBuffer::drawEdges.
+	MeshView allObjects() const;
+
+	static bool write(const std::string & path, const std::vector<SceneObject> & objects);
+
+	// Writes a scene with one object per OBJ or binary mesh file, each
+	// untransformed and black.  With a positive cellSize each mesh is split
+	// into one object per cubic cell of that size instead, as chunks for
+	// ChunkStreamer.
+	static bool convert(const std::vector<std::string> & meshFiles, const std::string & path,
+			float cellSize = 0.0f);
+
+	// True if the file starts with the scene file magic.
+	static bool isSceneFile(const std::string & path);
+
+private:
+	struct Header;
+	struct ObjectRecord;
+
+	// Not copyable: the mapping has one owner.
+	SceneFile(const SceneFile &) = delete;
+	SceneFile & operator=(const SceneFile &) = delete;
+
+	const ObjectRecord & record(size_t object) const;
+
+	const unsigned char * m_data;
+	size_t m_size;
+	const Header * m_header;
+	const ObjectRecord * m_objects;
+	PointArrays m_vertices;
+	const Edge * m_edges;
+
+	// Per object: unchecked, valid or invalid, for edgesValid().
+	std::string m_path;
+	std::unique_ptr<std::atomic<uint8_t>[]> m_edgeChecks;
+};
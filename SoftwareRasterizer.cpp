@@ -0,0 +1,292 @@
+#include "SoftwareRasterizer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+using namespace std;
+
+using namespace glm;
+
+namespace {
+
+uint32_t packPixel(const vec3 & colour)
+{
+	PackedVertex packed = packColour(colour);
+	return uint32_t(packed.r) | (uint32_t(packed.g) << 8) | (uint32_t(packed.b) << 16) |
+		(uint32_t(packed.a) << 24);
+}
+
+uint32_t packPixel(const PackedVertex & vertex)
+{
+	return uint32_t(vertex.r) | (uint32_t(vertex.g) << 8) | (uint32_t(vertex.b) << 16) |
+		(uint32_t(vertex.a) << 24);
+}
+
+// Maps an NDC coordinate to a pixel index in [0, size - 1].
+int toPixel(float ndc, int size)
+{
+	int pixel = int((ndc + 1.0f) * 0.5f * size);
+	return min(max(pixel, 0), size - 1);
+}
+
+void drawSpan(uint32_t * pixels, int width, int x0, int y0, int x1, int y1, uint32_t colour)
+{
+	int dx = x1 - x0;
+	int dy = y1 - y0;
+	int steps = max(abs(dx), abs(dy));
+	if (steps == 0) {
+		pixels[size_t(y0) * width + x0] = colour;
+		return;
+	}
+
+	// 16.16 fixed point: the major axis moves by exactly one pixel per step,
+	// so both coordinates are plain multiply-adds of the step index.  64-bit,
+	// as coordinates past 32767 overflow 32 bits once shifted.
+	int64_t stepX = int64_t(dx) * 65536 / steps;
+	int64_t stepY = int64_t(dy) * 65536 / steps;
+	int64_t startX = int64_t(x0) * 65536 + 0x8000;
+	int64_t startY = int64_t(y0) * 65536 + 0x8000;
+	for (int i = 0; i <= steps; i++) {
+		int x = int((startX + i * stepX) >> 16);
+		int y = int((startY + i * stepY) >> 16);
+		pixels[size_t(y) * width + x] = colour;
+	}
+}
+
+array<uint32_t, 256> makeCrcTable()
+{
+	array<uint32_t, 256> table;
+	for (uint32_t n = 0; n < 256; n++) {
+		uint32_t c = n;
+		for (int k = 0; k < 8; k++) {
+			c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+		}
+		table[n] = c;
+	}
+	return table;
+}
+
+uint32_t crc32(const uint8_t * data, size_t size, uint32_t crc)
+{
+	// Built on first use; the capture writer thread writes PNGs too.
+	static const array<uint32_t, 256> table = makeCrcTable();
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++) {
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+void appendBigEndian(vector<uint8_t> & out, uint32_t value)
+{
+	out.push_back(uint8_t(value >> 24));
+	out.push_back(uint8_t(value >> 16));
+	out.push_back(uint8_t(value >> 8));
+	out.push_back(uint8_t(value));
+}
+
+void writePngChunk(ofstream & out, const char * type, const vector<uint8_t> & data)
+{
+	vector<uint8_t> chunk;
+	appendBigEndian(chunk, uint32_t(data.size()));
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	uint32_t crc = crc32(chunk.data() + 4, chunk.size() - 4, 0);
+	appendBigEndian(chunk, crc);
+	out.write(reinterpret_cast<const char *>(chunk.data()), chunk.size());
+}
+
+bool hasSuffix(const string & s, const string & suffix)
+{
+	return s.size() >= suffix.size() &&
+		s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// The line between vertices "a" and "b" of "data", in a's colour.
+void drawLine(const VertexData & data, GLuint a, GLuint b, Framebuffer & target)
+{
+	int width = target.width();
+	int height = target.height();
+	vec2 v0;
+	vec2 v1;
+	uint32_t colour;
+	if (data.format == VertexFormat::Packed) {
+		v0 = unpackPosition(data.packed[a]);
+		v1 = unpackPosition(data.packed[b]);
+		colour = packPixel(data.packed[a]);
+	} else {
+		v0 = data.positions[a];
+		v1 = data.positions[b];
+		colour = packPixel(data.colours[a]);
+	}
+
+	// NDC y points up; image rows go down.
+	drawSpan(target.pixels.data(), width,
+			toPixel(v0[0], width), height - 1 - toPixel(v0[1], height),
+			toPixel(v1[0], width), height - 1 - toPixel(v1[1], height),
+			colour);
+}
+
+}
+
+//----------------------------------------------------------------------------------------
+// Constructor
+Framebuffer::Framebuffer(int width, int height)
+	: m_width(width),
+	  m_height(height)
+{
+	// An image whose byte size does not fit in size_t is left empty.
+	if (width <= 0 || height <= 0 ||
+			size_t(width) > SIZE_MAX / sizeof(uint32_t) / size_t(height)) {
+		if (width != 0 || height != 0) {
+			cerr << "Framebuffer: cannot hold a " << width << "x" << height << " image" << endl;
+		}
+		m_width = 0;
+		m_height = 0;
+	}
+	pixels.assign(size_t(m_width) * m_height, 0);
+}
+
+//----------------------------------------------------------------------------------------
+int Framebuffer::width() const
+{
+	return m_width;
+}
+
+//----------------------------------------------------------------------------------------
+int Framebuffer::height() const
+{
+	return m_height;
+}
+
+//----------------------------------------------------------------------------------------
+void Framebuffer::clear(const vec3 & colour)
+{
+	fill(pixels.begin(), pixels.end(), packPixel(colour));
+}
+
+//----------------------------------------------------------------------------------------
+bool Framebuffer::writePpm(const string & path) const
+{
+	ofstream out(path.c_str(), ios::binary);
+	if (!out) {
+		cerr << "Framebuffer: could not create " << path << endl;
+		return false;
+	}
+
+	out << "P6\n" << m_width << " " << m_height << "\n255\n";
+	vector<uint8_t> row(size_t(m_width) * 3);
+	for (int y = 0; y < m_height; y++) {
+		for (int x = 0; x < m_width; x++) {
+			uint32_t p = pixels[size_t(y) * m_width + x];
+			row[3 * x] = uint8_t(p);
+			row[3 * x + 1] = uint8_t(p >> 8);
+			row[3 * x + 2] = uint8_t(p >> 16);
+		}
+		out.write(reinterpret_cast<const char *>(row.data()), row.size());
+	}
+	return bool(out);
+}
+
+//----------------------------------------------------------------------------------------
+bool Framebuffer::writePng(const string & path) const
+{
+	ofstream out(path.c_str(), ios::binary);
+	if (!out) {
+		cerr << "Framebuffer: could not create " << path << endl;
+		return false;
+	}
+
+	const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	out.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+
+	// 8-bit RGBA, no interlacing.
+	vector<uint8_t> header;
+	appendBigEndian(header, uint32_t(m_width));
+	appendBigEndian(header, uint32_t(m_height));
+	header.push_back(8);
+	header.push_back(6);
+	header.push_back(0);
+	header.push_back(0);
+	header.push_back(0);
+	writePngChunk(out, "IHDR", header);
+
+	// Filter type 0 before each row, then the raw pixels.
+	size_t rowBytes = size_t(m_width) * 4 + 1;
+	vector<uint8_t> raw(rowBytes * m_height);
+	for (int y = 0; y < m_height; y++) {
+		raw[y * rowBytes] = 0;
+		const uint32_t * row = &pixels[size_t(y) * m_width];
+		for (int x = 0; x < m_width; x++) {
+			uint8_t * p = &raw[y * rowBytes + 1 + 4 * x];
+			p[0] = uint8_t(row[x]);
+			p[1] = uint8_t(row[x] >> 8);
+			p[2] = uint8_t(row[x] >> 16);
+			p[3] = uint8_t(row[x] >> 24);
+		}
+	}
+
+	// zlib stream of uncompressed deflate blocks; speed matters more than
+	// size for batch output, and it avoids a zlib dependency.
+	vector<uint8_t> zlib;
+	zlib.push_back(0x78);
+	zlib.push_back(0x01);
+	size_t offset = 0;
+	do {
+		size_t blockSize = min(raw.size() - offset, size_t(65535));
+		bool last = offset + blockSize == raw.size();
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back(uint8_t(blockSize));
+		zlib.push_back(uint8_t(blockSize >> 8));
+		zlib.push_back(uint8_t(~blockSize));
+		zlib.push_back(uint8_t(~blockSize >> 8));
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+		offset += blockSize;
+	} while (offset < raw.size());
+
+	uint32_t a = 1;
+	uint32_t b = 0;
+	for (uint8_t byte : raw) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	appendBigEndian(zlib, (b << 16) | a);
+	writePngChunk(out, "IDAT", zlib);
+
+	writePngChunk(out, "IEND", vector<uint8_t>());
+	return bool(out);
+}
+
+//----------------------------------------------------------------------------------------
+bool Framebuffer::write(const string & path) const
+{
+	if (hasSuffix(path, ".png") || hasSuffix(path, ".PNG")) {
+		return writePng(path);
+	}
+	return writePpm(path);
+}
+
+//----------------------------------------------------------------------------------------
+void rasterizeLines(const VertexData & data, Framebuffer & target)
+{
+	if (target.width() == 0 || target.height() == 0) {
+		return;
+	}
+
+	// Strips first, in the same order as the GL draw: every pair of
+	// neighbours within a strip.
+	for (GLsizei i = 0; i + 1 < data.numStripIndices; i++) {
+		GLuint a = data.stripIndices[i];
+		GLuint b = data.stripIndices[i + 1];
+		if (a != kRestartIndex && b != kRestartIndex) {
+			drawLine(data, a, b, target);
+		}
+	}
+
+	for (GLsizei i = 0; i + 1 < data.numIndices; i += 2) {
+		drawLine(data, data.indices[i], data.indices[i + 1], target);
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "VertexData.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// In-memory RGBA8 image, row 0 at the top.
+class Framebuffer {
+public:
+	Framebuffer(int width, int height);
+
+	int width() const;
+	int height() const;
+
+	void clear(const glm::vec3 & colour);
+
+	// Binary PPM (P6), or uncompressed PNG; write() picks from the extension.
+	bool writePpm(const std::string & path) const;
+	bool writePng(const std::string & path) const;
+	bool write(const std::string & path) const;
+
+	// 0xAABBGGRR, i.e. bytes R, G, B, A in memory.
+	std::vector<uint32_t> pixels;
+
+private:
+	int m_width;
+	int m_height;
+};
+
+
+// Draws the lines and strips in "data" (NDC coordinates, either vertex format)
+// into "target" with a fixed-point DDA: one pixel per step along the major
+// axis and no branches inside the loop.
+void rasterizeLines(const VertexData & data, Framebuffer & target);
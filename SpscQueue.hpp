@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread.  Neither side ever blocks: push fails when the queue is full and
+// pop fails when it is empty.
+template <typename T>
+class SpscQueue {
+public:
+	// Holds at least "capacity" values.
+	explicit SpscQueue(size_t capacity)
+		: m_head(0),
+		  m_tail(0)
+	{
+		size_t size = 1;
+		while (size < capacity + 1) {
+			size *= 2;
+		}
+		m_slots.resize(size);
+		m_mask = size - 1;
+	}
+
+	// Producer only.
+	bool push(const T & value)
+	{
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		size_t next = (tail + 1) & m_mask;
+		if (next == m_head.load(std::memory_order_acquire)) {
+			return false;
+		}
+		m_slots[tail] = value;
+		m_tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only.
+	bool pop(T & value)
+	{
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		value = m_slots[head];
+		m_head.store((head + 1) & m_mask, std::memory_order_release);
+		return true;
+	}
+
+private:
+	std::vector<T> m_slots;
+	size_t m_mask;
+
+	// Padded onto separate cache lines, so the two threads do not contend.
+	char m_padding0[64];
+	std::atomic<size_t> m_head;  // Next slot to pop; written by the consumer.
+	char m_padding1[64];
+	std::atomic<size_t> m_tail;  // Next slot to push; written by the producer.
+};
@@ -0,0 +1,140 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+using namespace std;
+
+//----------------------------------------------------------------------------------------
+// Constructor
+ThreadPool::ThreadPool(unsigned threadCount)
+	: m_generation(0),
+	  m_stopping(false),
+	  m_task(nullptr),
+	  m_remaining(0)
+{
+	if (threadCount == 0) {
+		threadCount = max(1u, thread::hardware_concurrency());
+	}
+
+	for (unsigned i = 0; i < threadCount; i++) {
+		m_workers.emplace_back(new Worker());
+	}
+	for (unsigned i = 1; i < threadCount; i++) {
+		m_threads.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+//----------------------------------------------------------------------------------------
+// Destructor
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+
+	for (thread & t : m_threads) {
+		t.join();
+	}
+}
+
+//----------------------------------------------------------------------------------------
+unsigned ThreadPool::workerCount() const
+{
+	return unsigned(m_workers.size());
+}
+
+//----------------------------------------------------------------------------------------
+void ThreadPool::parallelFor(size_t count, const Task & task)
+{
+	if (count == 0) {
+		return;
+	}
+	if (m_threads.empty() || count == 1) {
+		for (size_t i = 0; i < count; i++) {
+			task(i, 0);
+		}
+		return;
+	}
+
+	m_task = &task;
+	m_remaining = count;
+
+	// Deal contiguous ranges so neighbouring tasks usually run on one core.
+	size_t workers = m_workers.size();
+	for (size_t w = 0; w < workers; w++) {
+		lock_guard<mutex> lock(m_workers[w]->mutex);
+		for (size_t i = count * w / workers; i < count * (w + 1) / workers; i++) {
+			m_workers[w]->tasks.push_back(i);
+		}
+	}
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		++m_generation;
+	}
+	m_wake.notify_all();
+
+	while (runOne(0)) {
+	}
+
+	unique_lock<mutex> lock(m_mutex);
+	m_done.wait(lock, [this] { return m_remaining == 0; });
+	m_task = nullptr;
+}
+
+//----------------------------------------------------------------------------------------
+void ThreadPool::workerLoop(unsigned worker)
+{
+	unsigned seen = 0;
+	for (;;) {
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_wake.wait(lock, [&] { return m_stopping || m_generation != seen; });
+			if (m_stopping) {
+				return;
+			}
+			seen = m_generation;
+		}
+
+		while (runOne(worker)) {
+		}
+	}
+}
+
+//----------------------------------------------------------------------------------------
+bool ThreadPool::runOne(unsigned worker)
+{
+	size_t index = 0;
+	bool found = false;
+
+	// Own queue from the back, then steal from the front of the others.
+	size_t workers = m_workers.size();
+	for (size_t k = 0; k < workers && !found; k++) {
+		Worker & victim = *m_workers[(worker + k) % workers];
+		lock_guard<mutex> lock(victim.mutex);
+		if (victim.tasks.empty()) {
+			continue;
+		}
+		if (k == 0) {
+			index = victim.tasks.back();
+			victim.tasks.pop_back();
+		} else {
+			index = victim.tasks.front();
+			victim.tasks.pop_front();
+		}
+		found = true;
+	}
+
+	if (!found) {
+		return false;
+	}
+
+	(*m_task)(index, worker);
+
+	if (--m_remaining == 0) {
+		lock_guard<mutex> lock(m_mutex);
+		m_done.notify_all();
+	}
+	return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running indexed tasks.  Each worker owns a
+// queue of task indices; when it runs dry it steals from the front of the
+// other queues, so uneven tasks still keep every core busy.
+//
+// The thread calling parallelFor takes part as worker 0.
+class ThreadPool {
+public:
+	typedef std::function<void(size_t index, unsigned worker)> Task;
+
+	// threadCount includes the calling thread; 0 means one per hardware thread.
+	explicit ThreadPool(unsigned threadCount = 0);
+	~ThreadPool();
+
+	unsigned workerCount() const;
+
+	// Runs task(i, worker) for every i in [0, count) and returns once all
+	// have finished.  "worker" is in [0, workerCount()) and is never shared
+	// by two tasks running at the same time, so it can index scratch storage.
+	void parallelFor(size_t count, const Task & task);
+
+private:
+	struct Worker {
+		std::mutex mutex;
+		std::deque<size_t> tasks;
+	};
+
+	void workerLoop(unsigned worker);
+	bool runOne(unsigned worker);
+
+	std::vector<std::unique_ptr<Worker>> m_workers;
+	std::vector<std::thread> m_threads;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	unsigned m_generation;
+	bool m_stopping;
+
+	const Task * m_task;
+	std::atomic<size_t> m_remaining;
+};
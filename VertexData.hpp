@@ -0,0 +1,116 @@
+#pragma once
+
+#include "cs488-framework/OpenGLImport.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Initial number of vertices to reserve.  Storage grows on demand, so this
+// only needs to cover a typical frame.
+const GLsizei kInitialVertices = 1024;
+
+// Ends a line strip in VertexData::stripIndices.  Narrowed to 16 bits it is
+// still all ones, which is what the upload restarts on.
+const GLuint kRestartIndex = 0xFFFFFFFF;
+
+
+// Layouts a frame's vertices can be stored and uploaded in.
+enum class VertexFormat {
+	// vec2 position and vec3 colour in separate arrays: 20 bytes per vertex.
+	Float,
+
+	// One interleaved array of PackedVertex: 8 bytes per vertex.
+	Packed
+};
+
+
+// NDC position quantized to normalized int16, and RGBA8 colour.
+struct PackedVertex {
+	int16_t x;
+	int16_t y;
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+	uint8_t a;
+};
+
+PackedVertex packVertex(const glm::vec2 & position, const PackedVertex & colour);
+PackedVertex packColour(const glm::vec3 & colour);
+glm::vec2 unpackPosition(const PackedVertex & vertex);
+glm::vec3 unpackColour(const PackedVertex & vertex);
+
+
+// Convenience class for storing vertex data in CPU memory.
+// Data should be copied over to GPU memory via VBO storage before rendering.
+//
+// Lines are pairs of indices into the vertices, so a corner shared by
+// several lines is stored (and uploaded) once.  Connected lines can instead
+// be strips, one index per corner, drawn as GL_LINE_STRIP.
+class VertexData {
+public:
+	VertexData();
+
+	// Switch layout.  Any vertices already stored are discarded.
+	void setFormat(VertexFormat format);
+
+	// Forget the stored vertices and lines, keeping the storage.
+	void clear();
+
+	// Make room for at least "count" vertices, or indices, keeping existing
+	// ones.
+	void grow(size_t count);
+	void growIndices(size_t count);
+	void growStripIndices(size_t count);
+	size_t capacity() const;
+	size_t indexCapacity() const;
+	size_t stripCapacity() const;
+
+	// Append one vertex in the current format and return its index.
+	// "packedColour" must be packColour(colour); callers pack it once per
+	// colour change.
+	GLuint addVertex(const glm::vec2 & position, const glm::vec3 & colour,
+			const PackedVertex & packedColour);
+
+	// Append a line between two vertices already added.
+	void addLine(GLuint a, GLuint b);
+
+	// Append a line with two vertices of its own.
+	void addLine(const glm::vec2 & v0, const glm::vec2 & v1,
+			const glm::vec3 & colour, const PackedVertex & packedColour);
+
+	// Continue the open strip to a vertex already added; the first vertex
+	// after endStrip() starts a new one.
+	void addStripVertex(GLuint vertex);
+	void endStrip();
+
+	// Copy all of "source" (same format) to vertices [vertexOffset,
+	// vertexOffset + n), indices [indexOffset, indexOffset + m) and strip
+	// indices from stripOffset, moving its indices to where its vertices
+	// land.  The ranges must already be allocated; disjoint ranges may be
+	// written from different threads.
+	void copyAt(size_t vertexOffset, size_t indexOffset, size_t stripOffset,
+			const VertexData & source);
+
+	VertexFormat format;
+
+	// Used with VertexFormat::Float.
+	std::vector<glm::vec2> positions;
+	std::vector<glm::vec3> colours;
+
+	// Used with VertexFormat::Packed.
+	std::vector<PackedVertex> packed;
+
+	// Two per line.
+	std::vector<GLuint> indices;
+
+	// One per strip corner, each strip closed by kRestartIndex.
+	std::vector<GLuint> stripIndices;
+
+	GLuint index;
+	GLsizei numVertices;
+	GLsizei numIndices;
+	GLsizei numStripIndices;
+};
@@ -0,0 +1,397 @@
+#include "VertexStream.hpp"
+#include "cs488-framework/GlErrorCheck.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+using namespace std;
+
+using namespace glm;
+
+namespace {
+
+// How long a single glClientWaitSync call may block before it is retried,
+// in nanoseconds.
+const GLuint64 kFenceTimeout = 1000000;
+
+const GLbitfield kPersistentFlags =
+	GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+GLuint createBuffer(GLsizeiptr bytes, bool persistent, void ** mapped)
+{
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+	if (persistent) {
+		glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, kPersistentFlags);
+		*mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, kPersistentFlags);
+	} else {
+		// Set to GL_STREAM_DRAW because each region is written once per frame.
+		glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+		*mapped = nullptr;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return buffer;
+}
+
+void destroyBuffer(GLuint & buffer, void * & mapped)
+{
+	if (buffer == 0) {
+		return;
+	}
+	if (mapped) {
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		mapped = nullptr;
+	}
+	glDeleteBuffers(1, &buffer);
+	buffer = 0;
+}
+
+// Copy "bytes" bytes to "offset" in "buffer", either through its persistent
+// mapping or through a short-lived unsynchronized one.
+void writeBuffer(GLuint buffer, void * mapped, GLintptr offset, GLsizeiptr bytes,
+		const void * source)
+{
+	if (bytes == 0) {
+		return;
+	}
+	if (mapped) {
+		memcpy(static_cast<char *>(mapped) + offset, source, bytes);
+		return;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	void * region = glMapBufferRange(GL_ARRAY_BUFFER, offset, bytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	memcpy(region, source, bytes);
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+}
+
+//----------------------------------------------------------------------------------------
+// Constructor
+ChangedRange::ChangedRange()
+	: begin(SIZE_MAX),
+	  end(0)
+{
+}
+
+//----------------------------------------------------------------------------------------
+void ChangedRange::add(size_t first, size_t last)
+{
+	if (first < last) {
+		begin = min(begin, first);
+		end = max(end, last);
+	}
+}
+
+//----------------------------------------------------------------------------------------
+void ChangedRange::clear()
+{
+	begin = SIZE_MAX;
+	end = 0;
+}
+
+//----------------------------------------------------------------------------------------
+bool ChangedRange::empty() const
+{
+	return begin >= end;
+}
+
+//----------------------------------------------------------------------------------------
+void waitForFence(GLsync & sync)
+{
+	if (!sync) {
+		return;
+	}
+
+	GLenum result;
+	do {
+		result = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, kFenceTimeout);
+	} while (result == GL_TIMEOUT_EXPIRED);
+
+	glDeleteSync(sync);
+	sync = nullptr;
+}
+
+//----------------------------------------------------------------------------------------
+// Constructor
+VertexStream::VertexStream()
+	: m_persistent(false),
+	  m_capacity(0),
+	  m_indexCapacity(0),
+	  m_stripCapacity(0),
+	  m_indexType(GL_UNSIGNED_INT),
+	  m_format(VertexFormat::Float),
+	  m_region(0),
+	  m_positions(0),
+	  m_colours(0),
+	  m_interleaved(0),
+	  m_indices(0),
+	  m_mappedPositions(nullptr),
+	  m_mappedColours(nullptr),
+	  m_mappedInterleaved(nullptr),
+	  m_mappedIndices(nullptr)
+{
+	for (int i = 0; i < kRegions; i++) {
+		m_fences[i] = nullptr;
+	}
+}
+
+//----------------------------------------------------------------------------------------
+// Destructor
+VertexStream::~VertexStream()
+{
+	// GL objects are released in destroy(), while the context still exists.
+}
+
+//----------------------------------------------------------------------------------------
+void VertexStream::allocate(GLsizei capacity, GLsizei indexCapacity, GLsizei stripCapacity,
+		VertexFormat format)
+{
+	destroy();
+
+	m_persistent = gl3wIsSupported(4, 4) != 0;
+	m_capacity = capacity;
+	m_indexCapacity = indexCapacity;
+	m_stripCapacity = stripCapacity;
+	// 0xFFFF is the restart index, so it must not name a vertex.
+	m_indexType = (capacity < 0x10000) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	m_format = format;
+	m_region = 0;
+
+	// New buffers hold nothing yet.
+	for (int i = 0; i < kRegions; i++) {
+		m_staleVertices[i].clear();
+		m_staleVertices[i].add(0, capacity);
+		m_staleIndices[i].clear();
+		m_staleIndices[i].add(0, indexCapacity);
+		m_staleStrips[i].clear();
+		m_staleStrips[i].add(0, stripCapacity);
+	}
+
+	m_indices = createBuffer(indexSize() * (indexCapacity + stripCapacity) * kRegions,
+			m_persistent, &m_mappedIndices);
+
+	if (format == VertexFormat::Packed) {
+		m_interleaved = createBuffer(sizeof(PackedVertex) * capacity * kRegions,
+				m_persistent, &m_mappedInterleaved);
+	} else {
+		m_positions = createBuffer(sizeof(vec2) * capacity * kRegions, m_persistent,
+				&m_mappedPositions);
+		m_colours = createBuffer(sizeof(vec3) * capacity * kRegions, m_persistent,
+				&m_mappedColours);
+	}
+
+	CHECK_GL_ERRORS;
+}
+
+//----------------------------------------------------------------------------------------
+void VertexStream::destroy()
+{
+	// The GPU may still be reading the buffers from the last frames.
+	waitForAll();
+
+	destroyBuffer(m_positions, m_mappedPositions);
+	destroyBuffer(m_colours, m_mappedColours);
+	destroyBuffer(m_interleaved, m_mappedInterleaved);
+	destroyBuffer(m_indices, m_mappedIndices);
+	m_capacity = 0;
+	m_indexCapacity = 0;
+	m_stripCapacity = 0;
+}
+
+//----------------------------------------------------------------------------------------
+GLsizei VertexStream::capacity() const
+{
+	return m_capacity;
+}
+
+//----------------------------------------------------------------------------------------
+GLsizei VertexStream::indexCapacity() const
+{
+	return m_indexCapacity;
+}
+
+//----------------------------------------------------------------------------------------
+GLsizei VertexStream::stripCapacity() const
+{
+	return m_stripCapacity;
+}
+
+//----------------------------------------------------------------------------------------
+VertexFormat VertexStream::format() const
+{
+	return m_format;
+}
+
+//----------------------------------------------------------------------------------------
+GLuint VertexStream::positionBuffer() const
+{
+	return m_positions;
+}
+
+//----------------------------------------------------------------------------------------
+GLuint VertexStream::colourBuffer() const
+{
+	return m_colours;
+}
+
+//----------------------------------------------------------------------------------------
+GLuint VertexStream::interleavedBuffer() const
+{
+	return m_interleaved;
+}
+
+//----------------------------------------------------------------------------------------
+GLuint VertexStream::indexBuffer() const
+{
+	return m_indices;
+}
+
+//----------------------------------------------------------------------------------------
+GLenum VertexStream::indexType() const
+{
+	return m_indexType;
+}
+
+//----------------------------------------------------------------------------------------
+GLuint VertexStream::restartIndex() const
+{
+	return (m_indexType == GL_UNSIGNED_SHORT) ? 0xFFFF : kRestartIndex;
+}
+
+//----------------------------------------------------------------------------------------
+GLint VertexStream::upload(const VertexData & data, const ChangedRange & vertices,
+		const ChangedRange & indices, const ChangedRange & strips)
+{
+	markStale(vertices, m_staleVertices);
+	markStale(indices, m_staleIndices);
+	markStale(strips, m_staleStrips);
+
+	GLint current = m_region * m_capacity;
+	if (m_staleVertices[m_region].empty() && m_staleIndices[m_region].empty() &&
+			m_staleStrips[m_region].empty()) {
+		return current;
+	}
+
+	m_region = (m_region + 1) % kRegions;
+	waitForRegion(m_region);
+
+	size_t regionIndices = size_t(m_region) * (m_indexCapacity + m_stripCapacity);
+	writeIndices(data.indices, data.numIndices, regionIndices, m_staleIndices[m_region]);
+	writeIndices(data.stripIndices, data.numStripIndices, regionIndices + m_indexCapacity,
+			m_staleStrips[m_region]);
+
+	GLint first = m_region * m_capacity;
+	size_t begin = m_staleVertices[m_region].begin;
+	size_t end = min(m_staleVertices[m_region].end, size_t(data.numVertices));
+	m_staleVertices[m_region].clear();
+	if (begin >= end) {
+		return first;
+	}
+	size_t count = end - begin;
+
+	if (m_format == VertexFormat::Packed) {
+		writeBuffer(m_interleaved, m_mappedInterleaved, sizeof(PackedVertex) * (first + begin),
+				sizeof(PackedVertex) * count, &data.packed[begin]);
+	} else {
+		writeBuffer(m_positions, m_mappedPositions, sizeof(vec2) * (first + begin),
+				sizeof(vec2) * count, &data.positions[begin]);
+		writeBuffer(m_colours, m_mappedColours, sizeof(vec3) * (first + begin),
+				sizeof(vec3) * count, &data.colours[begin]);
+	}
+
+	return first;
+}
+
+//----------------------------------------------------------------------------------------
+const void * VertexStream::indexOffset() const
+{
+	size_t first = size_t(m_region) * (m_indexCapacity + m_stripCapacity);
+	return reinterpret_cast<const void *>(indexSize() * first);
+}
+
+//----------------------------------------------------------------------------------------
+const void * VertexStream::stripOffset() const
+{
+	size_t first = size_t(m_region) * (m_indexCapacity + m_stripCapacity) + m_indexCapacity;
+	return reinterpret_cast<const void *>(indexSize() * first);
+}
+
+//----------------------------------------------------------------------------------------
+size_t VertexStream::indexSize() const
+{
+	return (m_indexType == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(GLuint);
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Writes the stale part of the first "count" elements of "source" to the
+ * element buffer, "first" elements in, and marks it written.
+ */
+void VertexStream::writeIndices(const vector<GLuint> & source, size_t count, size_t first,
+		ChangedRange & stale)
+{
+	size_t begin = stale.begin;
+	size_t end = min(stale.end, count);
+	stale.clear();
+	if (begin >= end) {
+		return;
+	}
+	count = end - begin;
+	first += begin;
+
+	if (m_indexType == GL_UNSIGNED_INT) {
+		writeBuffer(m_indices, m_mappedIndices, sizeof(GLuint) * first, sizeof(GLuint) * count,
+				&source[begin]);
+		return;
+	}
+
+	// Narrowed on the way; a region this small never has an index past 16
+	// bits, and kRestartIndex narrows to the 16-bit restart index.
+	m_shortIndices.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		m_shortIndices[i] = uint16_t(source[begin + i]);
+	}
+	writeBuffer(m_indices, m_mappedIndices, sizeof(uint16_t) * first,
+			sizeof(uint16_t) * count, m_shortIndices.data());
+}
+
+//----------------------------------------------------------------------------------------
+void VertexStream::fence()
+{
+	if (m_fences[m_region]) {
+		glDeleteSync(m_fences[m_region]);
+	}
+	m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+//----------------------------------------------------------------------------------------
+void VertexStream::waitForRegion(int region)
+{
+	// With three regions this only waits when the GPU is two frames behind.
+	waitForFence(m_fences[region]);
+}
+
+//----------------------------------------------------------------------------------------
+void VertexStream::markStale(const ChangedRange & changed, ChangedRange * stale)
+{
+	for (int i = 0; i < kRegions; i++) {
+		stale[i].add(changed.begin, changed.end);
+	}
+}
+
+//----------------------------------------------------------------------------------------
+void VertexStream::waitForAll()
+{
+	for (int i = 0; i < kRegions; i++) {
+		waitForRegion(i);
+	}
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "VertexData.hpp"
+
+#include "cs488-framework/OpenGLImport.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Elements [begin, end) of a VertexData array that changed since the last
+// upload; empty when begin >= end.
+struct ChangedRange {
+	ChangedRange();
+
+	void add(size_t first, size_t last);
+	void clear();
+	bool empty() const;
+
+	size_t begin;
+	size_t end;
+};
+
+
+// Blocks until the GPU has passed "sync", then deletes it and sets it to
+// null.  Does nothing for a null sync.
+void waitForFence(GLsync & sync);
+
+
+// GPU side of the per-frame line vertices and indices.  Each buffer is split
+// into three regions used round-robin, and a fence per region tells us when
+// the GPU has finished reading it, so writing the next frame never waits on
+// the driver.
+//
+// Indices are relative to the first vertex of their region, and are stored
+// as 16-bit values whenever a region holds few enough vertices.  The element
+// buffer holds each region's line indices followed by its strip indices.
+//
+// With GL 4.4 the buffers are created with glBufferStorage and stay mapped
+// for their whole lifetime.  Older contexts map the region being written
+// with GL_MAP_UNSYNCHRONIZED_BIT instead, relying on the same fences.
+class VertexStream {
+public:
+	VertexStream();
+	~VertexStream();
+
+	// (Re)creates the buffers to hold "capacity" vertices, "indexCapacity"
+	// line indices and "stripCapacity" strip indices per region.  Any vertex
+	// array state that refers to the old buffers must be redone.
+	void allocate(GLsizei capacity, GLsizei indexCapacity, GLsizei stripCapacity,
+			VertexFormat format);
+	void destroy();
+
+	GLsizei capacity() const;
+	GLsizei indexCapacity() const;
+	GLsizei stripCapacity() const;
+	VertexFormat format() const;
+
+	// Separate position and colour buffers, used with VertexFormat::Float.
+	GLuint positionBuffer() const;
+	GLuint colourBuffer() const;
+
+	// Single buffer of PackedVertex, used with VertexFormat::Packed.
+	GLuint interleavedBuffer() const;
+
+	// The element array buffer; GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, with
+	// the all-ones value of that type ending a strip.
+	GLuint indexBuffer() const;
+	GLenum indexType() const;
+	GLuint restartIndex() const;
+
+	// Brings a region up to date with "data", given that only the vertices,
+	// line indices and strip indices in the given ranges differ from the
+	// previous upload, and returns the index of its first vertex, to be
+	// passed to glDrawElementsBaseVertex.  Each region remembers what changed
+	// since it was last written and copies only that; when nothing changed
+	// the current region is drawn again without copying.
+	GLint upload(const VertexData & data, const ChangedRange & vertices,
+			const ChangedRange & indices, const ChangedRange & strips);
+
+	// Byte offsets of the last uploaded region's line and strip indices in
+	// indexBuffer(), as glDrawElementsBaseVertex takes them.
+	const void * indexOffset() const;
+	const void * stripOffset() const;
+
+	// Call once the draw calls reading the last uploaded region are issued.
+	void fence();
+
+private:
+	static const int kRegions = 3;
+
+	void waitForRegion(int region);
+	void waitForAll();
+	void markStale(const ChangedRange & changed, ChangedRange * stale);
+	size_t indexSize() const;
+	void writeIndices(const std::vector<GLuint> & source, size_t count, size_t first,
+			ChangedRange & stale);
+
+	bool m_persistent;
+	GLsizei m_capacity;
+	GLsizei m_indexCapacity;
+	GLsizei m_stripCapacity;
+	GLenum m_indexType;
+	VertexFormat m_format;
+	int m_region;
+
+	GLuint m_positions;
+	GLuint m_colours;
+	GLuint m_interleaved;
+	GLuint m_indices;
+	void * m_mappedPositions;
+	void * m_mappedColours;
+	void * m_mappedInterleaved;
+	void * m_mappedIndices;
+	GLsync m_fences[kRegions];
+
+	// What each region has missed since it was last written.
+	ChangedRange m_staleVertices[kRegions];
+	ChangedRange m_staleIndices[kRegions];
+	ChangedRange m_staleStrips[kRegions];
+
+	std::vector<uint16_t> m_shortIndices;  // Scratch for 16-bit uploads.
+};
@@ -0,0 +1,163 @@
+#include "VertexTransform.hpp"
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace glm;
+
+//----------------------------------------------------------------------------------------
+void PointBatch::resize(size_t count)
+{
+	x.resize(count);
+	y.resize(count);
+	z.resize(count);
+	w.resize(count);
+}
+
+//----------------------------------------------------------------------------------------
+void PointBatch::clear()
+{
+	x.clear();
+	y.clear();
+	z.clear();
+	w.clear();
+}
+
+//----------------------------------------------------------------------------------------
+size_t PointBatch::size() const
+{
+	return x.size();
+}
+
+//----------------------------------------------------------------------------------------
+void PointBatch::set(size_t i, const vec4 & point)
+{
+	x[i] = point[0];
+	y[i] = point[1];
+	z[i] = point[2];
+	w[i] = point[3];
+}
+
+//----------------------------------------------------------------------------------------
+vec4 PointBatch::get(size_t i) const
+{
+	return vec4(x[i], y[i], z[i], w[i]);
+}
+
+//----------------------------------------------------------------------------------------
+void PointBatch::push_back(const vec4 & point)
+{
+	x.push_back(point[0]);
+	y.push_back(point[1]);
+	z.push_back(point[2]);
+	w.push_back(point[3]);
+}
+
+//----------------------------------------------------------------------------------------
+// Constructor
+PointArrays::PointArrays()
+	: x(nullptr),
+	  y(nullptr),
+	  z(nullptr),
+	  w(nullptr),
+	  count(0)
+{
+}
+
+//----------------------------------------------------------------------------------------
+// Constructor
+PointArrays::PointArrays(const PointBatch & batch)
+	: x(batch.x.data()),
+	  y(batch.y.data()),
+	  z(batch.z.data()),
+	  w(batch.w.data()),
+	  count(batch.size())
+{
+}
+
+//----------------------------------------------------------------------------------------
+void transformPoints(const mat4 & m, const PointBatch & in, PointBatch & out)
+{
+	out.resize(in.size());
+	transformPoints(m, in, out, 0, in.size());
+}
+
+//----------------------------------------------------------------------------------------
+void transformPoints(const mat4 & m, const PointArrays & in, PointBatch & out,
+		size_t begin, size_t end)
+{
+	size_t count = end - begin;
+
+	const float *inX = in.x + begin;
+	const float *inY = in.y + begin;
+	const float *inZ = in.z + begin;
+	const float *inW = in.w + begin;
+	float *outX = out.x.data() + begin;
+	float *outY = out.y.data() + begin;
+	float *outZ = out.z.data() + begin;
+	float *outW = out.w.data() + begin;
+
+	size_t i = 0;
+
+#if defined(__AVX__)
+	// m is column major, so row r of the result is sum over c of m[c][r] * p[c].
+	__m256 col[4][4];
+	for (int c = 0; c < 4; c++) {
+		for (int r = 0; r < 4; r++) {
+			col[c][r] = _mm256_set1_ps(m[c][r]);
+		}
+	}
+	for (; i + 8 <= count; i += 8) {
+		__m256 px = _mm256_loadu_ps(inX + i);
+		__m256 py = _mm256_loadu_ps(inY + i);
+		__m256 pz = _mm256_loadu_ps(inZ + i);
+		__m256 pw = _mm256_loadu_ps(inW + i);
+		__m256 r[4];
+		for (int k = 0; k < 4; k++) {
+			r[k] = _mm256_add_ps(
+					_mm256_add_ps(_mm256_mul_ps(col[0][k], px), _mm256_mul_ps(col[1][k], py)),
+					_mm256_add_ps(_mm256_mul_ps(col[2][k], pz), _mm256_mul_ps(col[3][k], pw)));
+		}
+		_mm256_storeu_ps(outX + i, r[0]);
+		_mm256_storeu_ps(outY + i, r[1]);
+		_mm256_storeu_ps(outZ + i, r[2]);
+		_mm256_storeu_ps(outW + i, r[3]);
+	}
+#elif defined(__SSE2__)
+	__m128 col[4][4];
+	for (int c = 0; c < 4; c++) {
+		for (int r = 0; r < 4; r++) {
+			col[c][r] = _mm_set1_ps(m[c][r]);
+		}
+	}
+	for (; i + 4 <= count; i += 4) {
+		__m128 px = _mm_loadu_ps(inX + i);
+		__m128 py = _mm_loadu_ps(inY + i);
+		__m128 pz = _mm_loadu_ps(inZ + i);
+		__m128 pw = _mm_loadu_ps(inW + i);
+		__m128 r[4];
+		for (int k = 0; k < 4; k++) {
+			r[k] = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(col[0][k], px), _mm_mul_ps(col[1][k], py)),
+					_mm_add_ps(_mm_mul_ps(col[2][k], pz), _mm_mul_ps(col[3][k], pw)));
+		}
+		_mm_storeu_ps(outX + i, r[0]);
+		_mm_storeu_ps(outY + i, r[1]);
+		_mm_storeu_ps(outZ + i, r[2]);
+		_mm_storeu_ps(outW + i, r[3]);
+	}
+#endif
+
+	// Scalar tail, and the whole batch on targets without SSE.
+	for (; i < count; i++) {
+		float px = inX[i];
+		float py = inY[i];
+		float pz = inZ[i];
+		float pw = inW[i];
+		outX[i] = m[0][0] * px + m[1][0] * py + m[2][0] * pz + m[3][0] * pw;
+		outY[i] = m[0][1] * px + m[1][1] * py + m[2][1] * pz + m[3][1] * pw;
+		outZ[i] = m[0][2] * px + m[1][2] * py + m[2][2] * pz + m[3][2] * pw;
+		outW[i] = m[0][3] * px + m[1][3] * py + m[2][3] * pz + m[3][3] * pw;
+	}
+}
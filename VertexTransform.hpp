@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// Homogeneous points stored as structure-of-arrays, so that the transform
+// kernel can load four (SSE) or eight (AVX) coordinates per register.
+class PointBatch {
+public:
+	void resize(size_t count);
+	void clear();
+	size_t size() const;
+
+	void set(size_t i, const glm::vec4 & point);
+	glm::vec4 get(size_t i) const;
+	void push_back(const glm::vec4 & point);
+
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+	std::vector<float> w;
+};
+
+// Read-only view of structure-of-arrays points, either a PointBatch's or
+// memory no batch owns, such as a mapped scene file.
+struct PointArrays {
+	PointArrays();
+	PointArrays(const PointBatch & batch);
+
+	const float * x;
+	const float * y;
+	const float * z;
+	const float * w;
+	size_t count;
+};
+
+// Compute out[i] = m * in[i] for every point in the batch.  The matrix should
+// be composed once per object; "in" and "out" may be the same batch.
+void transformPoints(const glm::mat4 & m, const PointBatch & in, PointBatch & out);
+
+// As above, for points [begin, end) only; "out" must already be large enough.
+// Lets several threads transform disjoint ranges of one batch.
+void transformPoints(const glm::mat4 & m, const PointArrays & in, PointBatch & out,
+		size_t begin, size_t end);
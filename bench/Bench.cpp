@@ -0,0 +1,383 @@
+// Microbenchmarks for the geometry pipeline stages, run on synthetic scenes.
+//
+//   A2_bench [--min-edges N] [--max-edges N] [--time SECONDS] [--out FILE]
+//
+// Prints one JSON document describing every (stage, scene size) pair to
+// stdout, or to FILE, and a readable summary to stderr.
+
+#include "ClipSpace.hpp"
+#include "GeometryPipeline.hpp"
+#include "LineClipper.hpp"
+#include "Mesh.hpp"
+#include "ThreadPool.hpp"
+#include "VertexData.hpp"
+#include "VertexTransform.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+using namespace glm;
+
+//----------------------------------------------------------------------------------------
+// Allocation counting.  Every stage is expected to reach a steady state in
+// which it allocates nothing per frame, so counts are taken after a warm-up.
+namespace {
+
+atomic<size_t> g_allocations(0);
+atomic<size_t> g_allocatedBytes(0);
+
+}
+
+void * operator new(size_t size)
+{
+	g_allocations.fetch_add(1, memory_order_relaxed);
+	g_allocatedBytes.fetch_add(size, memory_order_relaxed);
+	void * p = malloc(size ? size : 1);
+	if (!p) {
+		throw bad_alloc();
+	}
+	return p;
+}
+
+void * operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void * p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void * p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void * p, size_t) noexcept
+{
+	free(p);
+}
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+struct Options {
+	size_t minEdges;
+	size_t maxEdges;
+	double seconds;
+	string outPath;
+};
+
+struct Result {
+	string stage;
+	size_t edges;
+	size_t iterations;
+	double nsPerEdge;
+	double edgesPerSecond;
+	size_t allocations;
+	size_t allocatedBytes;
+};
+
+// Random vertices in a box straddling the view volume, so that a share of the
+// edges is trivially accepted, a share trivially rejected and the rest clipped.
+// Each edge joins a vertex to one of its neighbours in index order, which
+// gives the cache behaviour of a real mesh rather than of random pairs.
+Mesh syntheticScene(size_t edgeCount, unsigned seed)
+{
+	mt19937 random(seed);
+	uniform_real_distribution<float> position(-6.0f, 6.0f);
+	uniform_int_distribution<uint32_t> neighbour(1, 16);
+
+	Mesh mesh;
+	mesh.clear();
+	size_t vertexCount = max<size_t>(edgeCount / 2, 17);
+	mesh.vertices.resize(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++) {
+		mesh.vertices.set(i, vec4(position(random), position(random), position(random), 1.0f));
+	}
+	mesh.edges.resize(edgeCount);
+	for (size_t i = 0; i < edgeCount; i++) {
+		uint32_t a = uint32_t(i % vertexCount);
+		uint32_t b = uint32_t((a + neighbour(random)) % vertexCount);
+		mesh.edges[i].a = a;
+		mesh.edges[i].b = b;
+	}
+	return mesh;
+}
+
+// Same camera as the interactive app: looking down +z from z = -10.
+mat4 sceneMatrix()
+{
+	float fovDegrees = 30.0f;
+	float near = 1.0f;
+	float far = 30.0f;
+	float cottheta = 1.0f / tan(radians(fovDegrees / 2.0f));
+	mat4 proj(0.0f);
+	proj[0][0] = cottheta;
+	proj[1][1] = cottheta;
+	proj[2][2] = (far + near) / (far - near);
+	proj[3][2] = (-2.0f * far * near) / (far - near);
+	proj[2][3] = 1.0f;
+
+	mat4 view(1.0f);
+	view[3][2] = 10.0f;
+	return proj * view;
+}
+
+// Runs "body" once to warm caches and grow scratch storage, once more to
+// count its steady-state allocations, then repeatedly for at least "seconds",
+// and reports the median iteration.
+Result measure(const string & stage, size_t edges, double seconds,
+		const function<void()> & body)
+{
+	body();
+
+	size_t allocations = g_allocations.load();
+	size_t bytes = g_allocatedBytes.load();
+	body();
+	allocations = g_allocations.load() - allocations;
+	bytes = g_allocatedBytes.load() - bytes;
+
+	vector<double> times;
+	Clock::time_point start = Clock::now();
+	do {
+		Clock::time_point begin = Clock::now();
+		body();
+		times.push_back(chrono::duration<double, nano>(Clock::now() - begin).count());
+	} while (times.size() < 3 ||
+			chrono::duration<double>(Clock::now() - start).count() < seconds);
+
+	sort(times.begin(), times.end());
+	double median = times[times.size() / 2];
+
+	Result result;
+	result.stage = stage;
+	result.edges = edges;
+	result.iterations = times.size();
+	result.nsPerEdge = median / double(edges);
+	result.edgesPerSecond = double(edges) * 1e9 / median;
+	result.allocations = allocations;
+	result.allocatedBytes = bytes;
+	return result;
+}
+
+void benchScene(size_t edgeCount, const Options & options, ThreadPool & pool,
+		vector<Result> & results)
+{
+	Mesh mesh = syntheticScene(edgeCount, 488);
+	mat4 mvp = sceneMatrix();
+	ClipRect viewport = {-0.95f, 0.95f, -0.95f, 0.95f};
+	vec3 colour(1.0f, 1.0f, 1.0f);
+	PackedVertex packedColour = packColour(colour);
+	size_t vertexCount = mesh.vertices.size();
+	double seconds = options.seconds;
+
+	// Inputs for the stages measured in isolation.
+	PointBatch clipPoints;
+	transformPoints(mvp, mesh.vertices, clipPoints);
+	vector<uint8_t> outcodes;
+	computeOutcodes(clipPoints, outcodes);
+	vector<vec2> projected(vertexCount);
+
+	SegmentBatch segments;
+	segments.resize(edgeCount);
+	for (size_t i = 0; i < edgeCount; i++) {
+		const Edge & edge = mesh.edges[i];
+		segments.set(i, projectToViewport(clipPoints.get(edge.a), viewport),
+				projectToViewport(clipPoints.get(edge.b), viewport));
+	}
+	SegmentBatch clipped;
+
+	// Per-vertex stages are normalized per edge too, so every row compares.
+	results.push_back(measure("transform", edgeCount, seconds, [&]() {
+		transformPoints(mvp, mesh.vertices, clipPoints);
+	}));
+
+	results.push_back(measure("outcodes", edgeCount, seconds, [&]() {
+		computeOutcodes(clipPoints, outcodes);
+	}));
+
+	results.push_back(measure("project", edgeCount, seconds, [&]() {
+		for (size_t i = 0; i < vertexCount; i++) {
+			if (outcodes[i] == 0) {
+				projected[i] = projectToViewport(clipPoints.get(i), viewport);
+			}
+		}
+	}));
+
+	size_t kept = 0;
+	results.push_back(measure("clip_homogeneous", edgeCount, seconds, [&]() {
+		kept = 0;
+		for (size_t i = 0; i < edgeCount; i++) {
+			const Edge & edge = mesh.edges[i];
+			uint8_t code1 = outcodes[edge.a];
+			uint8_t code2 = outcodes[edge.b];
+			if ((code1 | code2) == 0) {
+				kept++;
+				continue;
+			}
+			vec4 point1 = clipPoints.get(edge.a);
+			vec4 point2 = clipPoints.get(edge.b);
+			if (clipHomogeneous(point1, point2, code1, code2)) {
+				kept++;
+			}
+		}
+	}));
+
+	results.push_back(measure("clip_xy_scalar", edgeCount, seconds, [&]() {
+		kept = 0;
+		for (size_t i = 0; i < edgeCount; i++) {
+			vec2 p0;
+			vec2 p1;
+			segments.get(i, p0, p1);
+			if (clipSegment(viewport, p0, p1)) {
+				kept++;
+			}
+		}
+	}));
+
+	results.push_back(measure("clip_xy_batch", edgeCount, seconds, [&]() {
+		clipped = segments;
+		clipSegments(viewport, clipped);
+	}));
+
+	VertexData vertices;
+	results.push_back(measure("emit", edgeCount, seconds, [&]() {
+		vertices.clear();
+		vertices.grow(2 * edgeCount);
+		for (size_t i = 0; i < edgeCount; i++) {
+			vec2 p0;
+			vec2 p1;
+			segments.get(i, p0, p1);
+			vertices.addLine(p0, p1, colour, packedColour);
+		}
+	}));
+
+	VertexData packed;
+	packed.setFormat(VertexFormat::Packed);
+	results.push_back(measure("emit_packed", edgeCount, seconds, [&]() {
+		packed.clear();
+		packed.grow(2 * edgeCount);
+		for (size_t i = 0; i < edgeCount; i++) {
+			vec2 p0;
+			vec2 p1;
+			segments.get(i, p0, p1);
+			packed.addLine(p0, p1, colour, packedColour);
+		}
+	}));
+
+	GeometryPipeline serial;
+	results.push_back(measure("pipeline", edgeCount, seconds, [&]() {
+		vertices.clear();
+		serial.drawMesh(mesh, mvp, viewport, colour, vertices);
+	}));
+
+	GeometryPipeline threaded;
+	threaded.setThreadPool(&pool);
+	results.push_back(measure("pipeline_threaded", edgeCount, seconds, [&]() {
+		vertices.clear();
+		threaded.drawMesh(mesh, mvp, viewport, colour, vertices);
+	}));
+}
+
+void writeJson(ostream & out, const vector<Result> & results, unsigned threads)
+{
+	out << "{\n";
+	out << "  \"threads\": " << threads << ",\n";
+	out << "  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		const Result & r = results[i];
+		out << "    {\"stage\": \"" << r.stage << "\""
+			<< ", \"edges\": " << r.edges
+			<< ", \"iterations\": " << r.iterations
+			<< ", \"ns_per_edge\": " << r.nsPerEdge
+			<< ", \"edges_per_second\": " << r.edgesPerSecond
+			<< ", \"allocations\": " << r.allocations
+			<< ", \"allocated_bytes\": " << r.allocatedBytes
+			<< "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n";
+	out << "}\n";
+}
+
+bool parseOptions(int argc, char **argv, Options & options)
+{
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--min-edges" && hasValue) {
+			options.minEdges = size_t(atof(argv[++i]));
+		} else if (arg == "--max-edges" && hasValue) {
+			options.maxEdges = size_t(atof(argv[++i]));
+		} else if (arg == "--time" && hasValue) {
+			options.seconds = atof(argv[++i]);
+		} else if (arg == "--out" && hasValue) {
+			options.outPath = argv[++i];
+		} else {
+			cerr << "Usage: " << argv[0]
+				<< " [--min-edges N] [--max-edges N] [--time SECONDS] [--out FILE]" << endl;
+			return false;
+		}
+	}
+	return options.minEdges > 0 && options.minEdges <= options.maxEdges;
+}
+
+}
+
+//----------------------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+	Options options;
+	options.minEdges = 1000;
+	options.maxEdges = 10000000;
+	options.seconds = 0.25;
+	if (!parseOptions(argc, argv, options)) {
+		return 1;
+	}
+
+	ThreadPool pool;
+	vector<Result> results;
+	for (size_t edges = options.minEdges; edges <= options.maxEdges; edges *= 10) {
+		size_t first = results.size();
+		benchScene(edges, options, pool, results);
+		for (size_t i = first; i < results.size(); i++) {
+			const Result & r = results[i];
+			fprintf(stderr, "%-18s %9zu edges %8.2f ns/edge %10.3g edges/s %4zu allocs\n",
+					r.stage.c_str(), r.edges, r.nsPerEdge, r.edgesPerSecond,
+					r.allocations);
+		}
+	}
+
+	if (options.outPath.empty()) {
+		writeJson(cout, results, pool.workerCount());
+		return 0;
+	}
+	ofstream out(options.outPath.c_str());
+	if (!out) {
+		cerr << "Cannot write " << options.outPath << endl;
+		return 1;
+	}
+	writeJson(out, results, pool.workerCount());
+	return 0;
+}
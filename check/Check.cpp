@@ -0,0 +1,40 @@
+// Consistency checks that are too slow for every start of the app.
+//
+//   A2_check [--segments N] [--seed N]
+//
+// Cross-checks the SIMD line clipper against its scalar reference on random
+// segments.  Prints the result to stderr and exits nonzero on any mismatch.
+
+#include "LineClipper.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+using namespace std;
+
+//----------------------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+	size_t segments = 100000;
+	unsigned seed = 488;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "--segments" && i + 1 < argc) {
+			segments = size_t(strtoull(argv[++i], nullptr, 10));
+		} else if (arg == "--seed" && i + 1 < argc) {
+			seed = unsigned(strtoul(argv[++i], nullptr, 10));
+		} else {
+			cerr << "Usage: A2_check [--segments N] [--seed N]" << endl;
+			return 1;
+		}
+	}
+
+	size_t clipMismatches = verifyLineClipper(segments, seed);
+	if (clipMismatches != 0) {
+		cerr << "Line clipper: " << clipMismatches << " of " << segments
+			<< " segments differ from the scalar reference" << endl;
+		return 1;
+	}
+	cerr << "Line clipper: " << segments << " segments match the scalar reference" << endl;
+	return 0;
+}
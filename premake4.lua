@@ -45,8 +45,26 @@ if os.get() == "macosx" then
     linkOptionList = { "-framework IOKit", "-framework Cocoa", "-framework CoreVideo", "-framework OpenGL" }
 end
 
+newoption {
+    trigger = "avx",
+    description = "Build the batch transform and clip kernels with AVX instead of SSE2"
+}
+
+newoption {
+    trigger = "avx512",
+    description = "Build the batch clip kernel with AVX-512 (16 lines per step)"
+}
+
 buildOptions = {"-std=c++11"}
 
+if _OPTIONS["avx"] then
+    table.insert(buildOptions, "-mavx")
+end
+
+if _OPTIONS["avx512"] then
+    table.insert(buildOptions, "-mavx512f")
+end
+
 solution "CS488-Projects"
     configurations { "Debug", "Release" }
 
@@ -63,6 +81,44 @@ solution "CS488-Projects"
         includedirs (includeDirList)
         files { "*.cpp" }
 
+    -- Stage microbenchmarks; needs no window, GL context or framework.
+    project "A2_bench"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/bench"
+        targetdir "."
+        buildoptions (buildOptions)
+        links { "pthread" }
+        includedirs (includeDirList)
+        includedirs { "." }
+        files {
+            "bench/*.cpp",
+            "Affine.cpp",
+            "ClipSpace.cpp",
+            "GeometryPipeline.cpp",
+            "LineClipper.cpp",
+            "Mesh.cpp",
+            "ThreadPool.cpp",
+            "VertexData.cpp",
+            "VertexTransform.cpp"
+        }
+
+    -- Consistency checks; exits nonzero when one fails.
+    project "A2_check"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/check"
+        targetdir "."
+        buildoptions (buildOptions)
+        includedirs (includeDirList)
+        includedirs { "." }
+        files {
+            "check/*.cpp",
+            "LineClipper.cpp"
+        }
+
     configuration "Debug"
         defines { "DEBUG" }
         flags { "Symbols" }